@@ -106,6 +106,9 @@ DialogEditProperties::~DialogEditProperties() {
 
 void DialogEditProperties::on_buttonBox_accepted() {
     if (mSelectedRows.size() == 1) {
+        //the view is told about all of the changes at once
+        mYaffsModel.beginTransaction();
+
         //name
         QString newName = mUi->lineName->text();
         mYaffsModel.setData(mNameIndex, newName);
@@ -141,6 +144,8 @@ void DialogEditProperties::on_buttonBox_accepted() {
             uint newGid = gidText.toUInt();
             mYaffsModel.setData(mGroupIndex, newGid);
         }
+
+        mYaffsModel.commitTransaction();
     }
 }
 
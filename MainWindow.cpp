@@ -34,6 +34,19 @@
 static const QString APPNAME = "Yaffey";
 static const QString VERSION = "0.2";
 
+//the first few chunk ids in a list, as " (chunks 3, 17, 18)"
+static QString eccChunkList(const QList<u32>& chunks) {
+    static const int MAXCHUNKS = 8;
+    QStringList ids;
+    for (int i = 0; i < chunks.size() && i < MAXCHUNKS; ++i) {
+        ids.append(QString::number(chunks.at(i)));
+    }
+    if (chunks.size() > MAXCHUNKS) {
+        ids.append("...");
+    }
+    return (ids.isEmpty() ? QString() : " (chunk" + QString(chunks.size() > 1 ? "s " : " ") + ids.join(", ") + ")");
+}
+
 MainWindow::MainWindow(QWidget* parent, QString imageFilename) : QMainWindow(parent),
                                                                  mUi(new Ui::MainWindow),
                                                                  mContextMenu(this) {
@@ -59,6 +72,16 @@ MainWindow::MainWindow(QWidget* parent, QString imageFilename) : QMainWindow(par
     mHeaderContextMenu.addAction(mUi->actionColumnUser);
     mHeaderContextMenu.addAction(mUi->actionColumnGroup);
 
+    //one entry per OOB layout, used when opening and saving images
+    mOobLayoutGroup = new QActionGroup(this);
+    for (int i = 0; i < YaffsControl::numOobLayouts(); ++i) {
+        QAction* action = mUi->menuOobLayout->addAction(YaffsControl::getOobLayout(i).name);
+        action->setCheckable(true);
+        action->setChecked(i == 0);
+        action->setData(i);
+        mOobLayoutGroup->addAction(action);
+    }
+
     //get YaffsManager instance and create model
     mYaffsManager = YaffsManager::getInstance();
     newModel();
@@ -96,7 +119,6 @@ MainWindow::MainWindow(QWidget* parent, QString imageFilename) : QMainWindow(par
     mUi->actionColumnGroup->setChecked(!mUi->treeView->isColumnHidden(YaffsItem::GROUP));
 
     connect(headerView, SIGNAL(customContextMenuRequested(QPoint)), SLOT(on_treeViewHeader_customContextMenuRequested(QPoint)));
-    connect(mUi->actionExpandAll, SIGNAL(triggered()), mUi->treeView, SLOT(expandAll()));
     connect(mUi->actionCollapseAll, SIGNAL(triggered()), mUi->treeView, SLOT(collapseAll()));
     connect(mUi->treeView, SIGNAL(selectionChanged()), SLOT(on_treeView_selectionChanged()));
 
@@ -108,6 +130,7 @@ MainWindow::MainWindow(QWidget* parent, QString imageFilename) : QMainWindow(par
     }
 
     mFastbootDialog = NULL;
+    mImportProgress = NULL;
 
     setupActions();
 }
@@ -115,23 +138,30 @@ MainWindow::MainWindow(QWidget* parent, QString imageFilename) : QMainWindow(par
 MainWindow::~MainWindow() {
     delete mUi;
     delete mFastbootDialog;
+    delete mImportProgress;
 }
 
 void MainWindow::newModel() {
     mYaffsModel = mYaffsManager->newModel();
     mUi->treeView->setModel(mYaffsModel);
     connect(mYaffsManager, SIGNAL(modelChanged()), SLOT(on_modelChanged()));
+    connect(mYaffsModel, SIGNAL(importProgress(int)), SLOT(on_model_ImportProgress(int)));
+    connect(mYaffsModel, SIGNAL(importFinished(int)), SLOT(on_model_ImportFinished(int)));
 }
 
 void MainWindow::on_treeView_doubleClicked(const QModelIndex& itemIndex) {
     YaffsItem* item = static_cast<YaffsItem*>(itemIndex.internalPointer());
     if (item) {
-        if (item->isFile() || item->isSymLink()) {
+        if (item->isFile() || item->isSymLink() || item->isHardLink()) {
             mUi->actionEditProperties->trigger();
         }
     }
 }
 
+void MainWindow::on_treeView_collapsed(const QModelIndex& itemIndex) {
+    mYaffsModel->releaseChildItems(itemIndex);
+}
+
 void MainWindow::on_actionNew_triggered() {
     newModel();
     mYaffsModel->newImage("new-yaffs2.img");
@@ -160,8 +190,15 @@ void MainWindow::updateWindowTitle() {
     }
 }
 
+int MainWindow::selectedOobLayout() const {
+    QAction* action = mOobLayoutGroup->checkedAction();
+    return (action ? action->data().toInt() : 0);
+}
+
 void MainWindow::openImage(const QString& imageFilename) {
     if (imageFilename.length() > 0) {
+        mYaffsModel->setVerifyTags(mUi->actionVerifyTags->isChecked());
+        mYaffsModel->setOobLayout(selectedOobLayout());
         YaffsReadInfo readInfo = mYaffsModel->openImage(imageFilename);
         if (readInfo.result) {
             QModelIndex rootIndex = mYaffsModel->index(0, 0);
@@ -178,11 +215,21 @@ void MainWindow::openImage(const QString& imageFilename) {
                             "<tr><td width=120>Specials:</td><td>" + QString::number(readInfo.numSpecials) + "</td></tr>" +
                             "<tr><td width=120>Unknowns:</td><td>" + QString::number(readInfo.numUnknowns) + "</td></tr>" +
                             "<tr><td colspan=2><hr/></td></tr>" +
-                            "<tr><td width=120>Errors:</td><td>" + QString::number(readInfo.numErrorousObjects) + "</td></tr></table>");
+                            "<tr><td width=120>Errors:</td><td>" + QString::number(readInfo.numErrorousObjects) + "</td></tr>" +
+                            "<tr><td width=120>Obsolete headers:</td><td>" + QString::number(readInfo.numObsoleteHeaders) + "</td></tr>");
+
+            if (readInfo.tagsVerified) {
+                summary += "<tr><td width=120>Tags corrected:</td><td>" + QString::number(readInfo.numTagsCorrected) + "</td></tr>" +
+                           "<tr><td width=120>Tags unreadable:</td><td>" + QString::number(readInfo.numTagsUncorrectable) + "</td></tr>";
+            }
+            summary += "</table>";
 
             if (readInfo.eofHasIncompletePage) {
                 summary += "<br/><br/>Warning:<br/>Incomplete page found at end of file";
             }
+            if (readInfo.numTagsUncorrectable > 0) {
+                summary += "<br/><br/>Warning:<br/>Pages with unreadable tags were left out, the tree may be incomplete";
+            }
             QMessageBox::information(this, "Summary", summary);
         } else {
             QString msg = "Error opening image: " + imageFilename;
@@ -204,12 +251,33 @@ void MainWindow::on_actionClose_triggered() {
     setupActions();
 }
 
+void MainWindow::on_actionSave_triggered() {
+    if (mYaffsModel->isImageOpen()) {
+        QString imageFilename = mYaffsModel->getImageFilename();
+        if (mYaffsModel->isNewImage() || !QFile::exists(imageFilename)) {
+            //a new image has nowhere to go yet
+            on_actionSaveAs_triggered();
+        } else if (mYaffsModel->isDirty()) {
+            mYaffsModel->setDeduplicate(mUi->actionDeduplicate->isChecked());
+            if (mYaffsModel->save()) {
+                mUi->statusBar->showMessage("Image saved: " + imageFilename);
+            } else {
+                QString msg = "Error saving image: " + imageFilename;
+                QMessageBox::critical(this, "Error", msg);
+                mUi->statusBar->showMessage(msg);
+            }
+            setupActions();
+        }
+    }
+}
+
 void MainWindow::on_actionSaveAs_triggered() {
     if (mYaffsModel->isImageOpen()) {
         QString imgName = mYaffsModel->getImageFilename();
         QString saveAsFilename = QFileDialog::getSaveFileName(this, "Save Image As", "./" + imgName);
         if (saveAsFilename.length() > 0) {
-            YaffsSaveInfo saveInfo = mYaffsModel->saveAs(saveAsFilename);
+            mYaffsModel->setDeduplicate(mUi->actionDeduplicate->isChecked());
+            YaffsSaveInfo saveInfo = mYaffsModel->saveAs(saveAsFilename, selectedOobLayout());
             updateWindowTitle();
             if (saveInfo.result) {
                 mUi->statusBar->showMessage("Image saved: " + saveAsFilename);
@@ -217,10 +285,12 @@ void MainWindow::on_actionSaveAs_triggered() {
                                 "<tr><td width=120>Files:</td><td>" + QString::number(saveInfo.numFilesSaved) + "</td></tr>" +
                                 "<tr><td width=120>Directories:</td><td>" + QString::number(saveInfo.numDirsSaved) + "</td></tr>" +
                                 "<tr><td width=120>SymLinks:</td><td>" + QString::number(saveInfo.numSymLinksSaved) + "</td></tr>" +
+                                "<tr><td width=120>HardLinks:</td><td>" + QString::number(saveInfo.numHardLinksSaved) + "</td></tr>" +
                                 "<tr><td colspan=2><hr/></td></tr>" +
                                 "<tr><td width=120>Files Failed:</td><td>" + QString::number(saveInfo.numFilesFailed) + "</td></tr>" +
                                 "<tr><td width=120>Directories Failed:</td><td>" + QString::number(saveInfo.numDirsFailed) + "</td></tr>" +
-                                "<tr><td width=120>SymLinks Failed:</td><td>" + QString::number(saveInfo.numSymLinksFailed) + "</td></tr></td></tr></table>");
+                                "<tr><td width=120>SymLinks Failed:</td><td>" + QString::number(saveInfo.numSymLinksFailed) + "</td></tr>" +
+                                "<tr><td width=120>HardLinks Failed:</td><td>" + QString::number(saveInfo.numHardLinksFailed) + "</td></tr></table>");
                 QMessageBox::information(this, "Save summary", summary);
             } else {
                 QString msg = "Error saving image: " + saveAsFilename;
@@ -240,10 +310,12 @@ void MainWindow::on_actionImport_triggered() {
         YaffsItem* parentItem = static_cast<YaffsItem*>(parentIndex.internalPointer());
         if (parentItem && parentItem->isDir()) {
             QStringList fileNames = QFileDialog::getOpenFileNames(this, "Select file(s) to import...");
+            mYaffsModel->beginTransaction();
             foreach (QString importFilename, fileNames) {
                 importFilename.replace('\\', '/');
                 mYaffsModel->importFile(parentItem, importFilename);
             }
+            mYaffsModel->commitTransaction();
         }
     } else if (result == DialogImport::RESULT_DIRECTORY) {
         QModelIndex parentIndex = mUi->treeView->selectionModel()->currentIndex();
@@ -252,7 +324,15 @@ void MainWindow::on_actionImport_triggered() {
             QString directoryName = QFileDialog::getExistingDirectory(this, "Select directory to import...");
             if (directoryName.length() > 0) {
                 directoryName.replace('\\', '/');
-                mYaffsModel->importDirectory(parentItem, directoryName);
+                if (mYaffsModel->importDirectory(parentItem, directoryName)) {
+                    //the window stays responsive while the directory is read, but can't be changed until it's imported
+                    mImportProgress = new QProgressDialog("Reading " + directoryName + "...", "Cancel", 0, 0, this);
+                    mImportProgress->setWindowTitle("Import");
+                    mImportProgress->setWindowModality(Qt::WindowModal);
+                    mImportProgress->setMinimumDuration(500);
+                    connect(mImportProgress, SIGNAL(canceled()), mYaffsModel, SLOT(cancelImport()));
+                    mUi->statusBar->showMessage("Importing " + directoryName);
+                }
             }
         }
     }
@@ -301,6 +381,15 @@ void MainWindow::on_actionEditProperties_triggered() {
     setupActions();
 }
 
+void MainWindow::on_actionExpandAll_triggered() {
+    //items below unexpanded directories don't exist until fetched
+    QModelIndex rootIndex = mYaffsModel->index(0, 0);
+    if (rootIndex.isValid()) {
+        mYaffsModel->fetchAll(static_cast<YaffsItem*>(rootIndex.internalPointer()));
+    }
+    mUi->treeView->expandAll();
+}
+
 void MainWindow::on_actionAndroidFastboot_triggered() {
     if (mFastbootDialog) {
         mFastbootDialog->show();
@@ -404,6 +493,23 @@ void MainWindow::on_treeView_customContextMenuRequested(const QPoint& pos) {
     mContextMenu.exec(p);
 }
 
+void MainWindow::on_model_ImportProgress(int itemsFound) {
+    if (mImportProgress) {
+        mImportProgress->setLabelText("Found " + QString::number(itemsFound) + " files and directories...");
+    }
+}
+
+void MainWindow::on_model_ImportFinished(int itemsImported) {
+    delete mImportProgress;
+    mImportProgress = NULL;
+
+    if (itemsImported > 0) {
+        mUi->statusBar->showMessage("Imported " + QString::number(itemsImported) + " files and directories");
+    } else {
+        mUi->statusBar->showMessage("Import cancelled");
+    }
+}
+
 void MainWindow::on_modelChanged() {
     setupActions();
 }
@@ -415,7 +521,7 @@ void MainWindow::on_treeView_selectionChanged() {
 void MainWindow::exportSelectedItems(const QString& path) {
     QModelIndexList selectedRows = mUi->treeView->selectionModel()->selectedRows();
     if (selectedRows.size() > 0) {
-        YaffsExportInfo* exportInfo = mYaffsManager->exportItems(selectedRows, path);
+        YaffsExportInfo* exportInfo = mYaffsManager->exportItems(selectedRows, path, mUi->actionVerifyDataEcc->isChecked());
 
         QString status = "Exported " + QString::number(exportInfo->numDirsExported) + " dir(s) and " +
                                        QString::number(exportInfo->numFilesExported) + " file(s).";
@@ -463,6 +569,47 @@ void MainWindow::exportSelectedItems(const QString& path) {
             QMessageBox::critical(this, "Export", msg);
         }
 
+        int eccUncorrectable = exportInfo->listFileEccUncorrectable.size();
+        int eccCorrected = exportInfo->listFileEccCorrected.size();
+        if (eccUncorrectable + eccCorrected > 0) {
+            QString msg;
+            static const int MAXFILES = 10;
+
+            if (eccUncorrectable > 0) {
+                QString items;
+                int max = (eccUncorrectable > MAXFILES ? MAXFILES : eccUncorrectable);
+                for (int i = 0; i < max; ++i) {
+                    const YaffsItem* item = exportInfo->listFileEccUncorrectable.at(i);
+                    items += item->getFullPath() + eccChunkList(exportInfo->fileEccUncorrectableChunks.value(item)) + "\n";
+                }
+                msg += "Exported files with data the ECC couldn't correct:\n" + items;
+
+                if (eccUncorrectable > MAXFILES) {
+                    msg += "... plus " + QString::number(eccUncorrectable - MAXFILES) + " more\n";
+                }
+            }
+
+            if (eccCorrected > 0) {
+                if (eccUncorrectable > 0) {
+                    msg += "\n";
+                }
+
+                QString items;
+                int max = (eccCorrected > MAXFILES ? MAXFILES : eccCorrected);
+                for (int i = 0; i < max; ++i) {
+                    const YaffsItem* item = exportInfo->listFileEccCorrected.at(i);
+                    items += item->getFullPath() + "\n";
+                }
+                msg += "Exported files with single bit errors corrected by the ECC:\n" + items;
+
+                if (eccCorrected > MAXFILES) {
+                    msg += "... plus " + QString::number(eccCorrected - MAXFILES) + " more";
+                }
+            }
+
+            QMessageBox::warning(this, "Export", msg);
+        }
+
         delete exportInfo;
     }
 }
@@ -477,7 +624,7 @@ int MainWindow::identifySelection(const QModelIndexList& selectedRows) {
         if (item) {
             selectionFlags |= (item->isRoot() ? SELECTED_ROOT : 0);
             selectionFlags |= (item->isDir() ? SELECTED_DIR : 0);
-            selectionFlags |= (item->isFile() ? SELECTED_FILE : 0);
+            selectionFlags |= (item->isFile() || item->isHardLink() ? SELECTED_FILE : 0);
             selectionFlags |= (item->isSymLink() ? SELECTED_SYMLINK : 0);
         }
     }
@@ -495,10 +642,12 @@ void MainWindow::setupActions() {
     if (mYaffsModel->index(0, 0).isValid()) {
         mUi->actionExpandAll->setEnabled(true);
         mUi->actionCollapseAll->setEnabled(true);
+        mUi->actionSave->setEnabled(mYaffsModel->isDirty());
         mUi->actionSaveAs->setEnabled(true);
     } else {
         mUi->actionExpandAll->setEnabled(false);
         mUi->actionCollapseAll->setEnabled(false);
+        mUi->actionSave->setEnabled(false);
         mUi->actionSaveAs->setEnabled(false);
     }
 
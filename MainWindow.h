@@ -22,6 +22,8 @@
 #include <QMainWindow>
 #include <QStandardItemModel>
 #include <QMenu>
+#include <QActionGroup>
+#include <QProgressDialog>
 
 #include "YaffsModel.h"
 #include "YaffsManager.h"
@@ -45,9 +47,11 @@ public:
 
 private slots:
     void on_treeView_doubleClicked(const QModelIndex& index);
+    void on_treeView_collapsed(const QModelIndex& index);
     void on_actionNew_triggered();
     void on_actionOpen_triggered();
     void on_actionClose_triggered();
+    void on_actionSave_triggered();
     void on_actionSaveAs_triggered();
     void on_actionImport_triggered();
     void on_actionExport_triggered();
@@ -55,6 +59,7 @@ private slots:
     void on_actionRename_triggered();
     void on_actionDelete_triggered();
     void on_actionEditProperties_triggered();
+    void on_actionExpandAll_triggered();
     void on_actionAndroidFastboot_triggered();
     void on_actionAbout_triggered();
     void on_actionColumnName_triggered();
@@ -70,6 +75,8 @@ private slots:
     void on_treeView_customContextMenuRequested(const QPoint& pos);
     void on_treeView_selectionChanged();
     void on_modelChanged();
+    void on_model_ImportProgress(int itemsFound);
+    void on_model_ImportFinished(int itemsImported);
 
 private:
     void newModel();
@@ -78,6 +85,7 @@ private:
     void exportSelectedItems(const QString& path);
     void setupActions();
     void updateWindowTitle();
+    int selectedOobLayout() const;
     int identifySelection(const QModelIndexList& selectedRows);
 
 private:
@@ -86,7 +94,9 @@ private:
     YaffsManager* mYaffsManager;        //not owned - singleton
     QMenu mContextMenu;
     QMenu mHeaderContextMenu;
+    QActionGroup* mOobLayoutGroup;      //owned by this
     QDialog* mFastbootDialog;           //owned
+    QProgressDialog* mImportProgress;   //owned, while a directory is being imported
 };
 
 #endif  //MAINWINDOW_H
@@ -27,4 +27,7 @@ extern "C" {
 #define SPARE_SIZE  64
 #define PAGE_SIZE   (CHUNK_SIZE + SPARE_SIZE)
 
+#define PAGES_PER_BLOCK 64
+#define BLOCK_SIZE      (PAGES_PER_BLOCK * PAGE_SIZE)
+
 #endif  //YAFFS_H
@@ -0,0 +1,278 @@
+/*
+ * yaffey: Utility for reading, editing and writing YAFFS2 images
+ * Copyright (C) 2012 David Place <david.t.place@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <QDebug>
+
+#include <string.h>
+
+#include "YaffsChunkMap.h"
+
+//chunk ids above this can't belong to a file that fits file_size_low, so they're treated as corrupt tags
+#define MAX_FILE_CHUNKS     (0x100000000LL / CHUNK_SIZE)
+
+YaffsChunkMap::YaffsChunkMap() {
+}
+
+void YaffsChunkMap::addChunk(u32 objectId, u32 chunkId, u32 page, u32 sequenceNumber) {
+    if (chunkId == 0 || chunkId > MAX_FILE_CHUNKS) {
+        return;
+    }
+
+    if (!mRuns.isEmpty()) {
+        Run& run = mRuns.last();
+        if (run.numChunks > 0 && run.objectId == objectId && run.sequenceNumber == sequenceNumber &&
+                run.firstChunk + run.numChunks == chunkId && run.firstPage + run.numChunks == page) {
+            run.numChunks++;
+            return;
+        }
+    }
+
+    Run run;
+    run.objectId = objectId;
+    run.firstChunk = chunkId;
+    run.numChunks = 1;
+    run.firstPage = page;
+    run.sequenceNumber = sequenceNumber;
+    mRuns.append(run);
+}
+
+//a shrink header at page, the chunks of the object written before it that are past fileSize are gone
+void YaffsChunkMap::addShrink(u32 objectId, u32 fileSize, u32 page, u32 sequenceNumber) {
+    Run run;
+    run.objectId = objectId;
+    run.firstChunk = (fileSize + CHUNK_SIZE - 1) / CHUNK_SIZE + 1;
+    run.numChunks = 0;
+    run.firstPage = page;
+    run.sequenceNumber = sequenceNumber;
+    mRuns.append(run);
+}
+
+void YaffsChunkMap::append(const YaffsChunkMap& other) {
+    mRuns += other.mRuns;
+}
+
+void YaffsChunkMap::build() {
+    build(NULL);
+}
+
+//only the chunks of the given objects are kept, e.g. to leave out deleted files
+void YaffsChunkMap::build(const QSet<u32>& objectIds) {
+    build(&objectIds);
+}
+
+void YaffsChunkMap::clear() {
+    mRuns.clear();
+    mExtents.clear();
+    mObjectExtents.clear();
+}
+
+QVector<YaffsChunkMap::Extent> YaffsChunkMap::getExtents(u32 objectId) const {
+    QPair<int, int> extents = mObjectExtents.value(objectId, qMakePair(0, 0));
+    return mExtents.mid(extents.first, extents.second);
+}
+
+//page index of a chunk in the image, or -1 if the chunk was never written
+long YaffsChunkMap::findPage(u32 objectId, u32 chunkId) const {
+    QHash<u32, QPair<int, int> >::const_iterator i = mObjectExtents.constFind(objectId);
+    if (i != mObjectExtents.constEnd()) {
+        const Extent* extents = mExtents.constData() + i.value().first;
+        int low = 0;
+        int high = i.value().second;
+        while (low < high) {
+            int mid = (low + high) / 2;
+            if (extents[mid].firstChunk <= chunkId) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+
+        if (low > 0) {
+            const Extent& extent = extents[low - 1];
+            if (chunkId < extent.firstChunk + extent.numChunks) {
+                return extent.firstPage + (chunkId - extent.firstChunk);
+            }
+        }
+    }
+    return -1;
+}
+
+int YaffsChunkMap::memoryUsage() const {
+    return sizeof(YaffsChunkMap) +
+           mRuns.capacity() * sizeof(Run) +
+           mExtents.capacity() * sizeof(Extent) +
+           mObjectExtents.size() * (sizeof(u32) + sizeof(QPair<int, int>) + sizeof(void*) * 2);
+}
+
+//object count, then (object id, first extent, extent count) for each object, then the extents
+QByteArray YaffsChunkMap::toByteArray() const {
+    u32 numObjects = mObjectExtents.size();
+    QByteArray data;
+    data.reserve(sizeof(u32) + numObjects * sizeof(u32) * 3 + mExtents.size() * sizeof(Extent));
+    data.append(reinterpret_cast<const char*>(&numObjects), sizeof(u32));
+
+    QHash<u32, QPair<int, int> >::const_iterator i;
+    for (i = mObjectExtents.constBegin(); i != mObjectExtents.constEnd(); ++i) {
+        u32 object[3] = { i.key(), static_cast<u32>(i.value().first), static_cast<u32>(i.value().second) };
+        data.append(reinterpret_cast<const char*>(object), sizeof(object));
+    }
+    data.append(reinterpret_cast<const char*>(mExtents.constData()), mExtents.size() * sizeof(Extent));
+    return data;
+}
+
+bool YaffsChunkMap::fromByteArray(const QByteArray& data) {
+    clear();
+
+    u32 numObjects;
+    if (data.size() < static_cast<int>(sizeof(u32))) {
+        return false;
+    }
+    memcpy(&numObjects, data.constData(), sizeof(u32));
+
+    int objectsSize = numObjects * sizeof(u32) * 3;
+    int extentsSize = data.size() - sizeof(u32) - objectsSize;
+    if (numObjects > static_cast<u32>(data.size()) || extentsSize < 0 || extentsSize % sizeof(Extent) != 0) {
+        return false;
+    }
+
+    u32 numExtents = extentsSize / sizeof(Extent);
+    mExtents.resize(numExtents);
+    memcpy(mExtents.data(), data.constData() + sizeof(u32) + objectsSize, extentsSize);
+
+    const char* objectData = data.constData() + sizeof(u32);
+    for (u32 n = 0; n < numObjects; ++n) {
+        u32 object[3];
+        memcpy(object, objectData + n * sizeof(object), sizeof(object));
+        if (object[1] > numExtents || object[2] > numExtents - object[1]) {
+            clear();
+            return false;
+        }
+        mObjectExtents.insert(object[0], qMakePair(static_cast<int>(object[1]), static_cast<int>(object[2])));
+    }
+    return true;
+}
+
+//by object, then oldest first so that newer copies of a chunk replace older ones
+bool YaffsChunkMap::isEarlierRun(const Run& a, const Run& b) {
+    if (a.objectId != b.objectId) {
+        return (a.objectId < b.objectId);
+    }
+    if (a.sequenceNumber != b.sequenceNumber) {
+        return (a.sequenceNumber < b.sequenceNumber);
+    }
+    return (a.firstPage < b.firstPage);
+}
+
+void YaffsChunkMap::build(const QSet<u32>* objectIds) {
+    qSort(mRuns.begin(), mRuns.end(), isEarlierRun);
+
+    QVector<qint64> pages;
+    bool merged = false;
+    int numRuns = mRuns.size();
+    int first = 0;
+    while (first < numRuns) {
+        u32 objectId = mRuns.at(first).objectId;
+        u32 numChunks = 0;
+        int end = first;
+        while (end < numRuns && mRuns.at(end).objectId == objectId) {
+            const Run& run = mRuns.at(end);
+            numChunks = qMax(numChunks, run.firstChunk + run.numChunks);
+            ++end;
+        }
+
+        if (objectIds == NULL || objectIds->contains(objectId)) {
+            //the chunks the object already has are older than any run merged into the map
+            QVector<Extent> oldExtents;
+            if (mObjectExtents.contains(objectId)) {
+                oldExtents = getExtents(objectId);
+                if (!oldExtents.isEmpty()) {
+                    numChunks = qMax(numChunks, oldExtents.last().firstChunk + oldExtents.last().numChunks);
+                }
+                merged = true;
+            }
+
+            //lay the runs over each other, then read the result back as extents
+            pages.fill(-1, numChunks);
+            foreach (const Extent& extent, oldExtents) {
+                for (u32 c = 0; c < extent.numChunks; ++c) {
+                    pages[extent.firstChunk + c] = extent.firstPage + c;
+                }
+            }
+            for (int r = first; r < end; ++r) {
+                const Run& run = mRuns.at(r);
+                if (run.numChunks == 0) {
+                    for (u32 c = run.firstChunk; c < numChunks; ++c) {
+                        pages[c] = -1;
+                    }
+                }
+                for (u32 c = 0; c < run.numChunks; ++c) {
+                    pages[run.firstChunk + c] = run.firstPage + c;
+                }
+            }
+
+            int firstExtent = mExtents.size();
+            for (u32 chunk = 1; chunk < numChunks; ++chunk) {
+                qint64 page = pages.at(chunk);
+                if (page == -1) {
+                    continue;
+                }
+
+                if (mExtents.size() > firstExtent) {
+                    Extent& extent = mExtents.last();
+                    if (extent.firstChunk + extent.numChunks == chunk && extent.firstPage + extent.numChunks == page) {
+                        extent.numChunks++;
+                        continue;
+                    }
+                }
+
+                Extent extent;
+                extent.firstChunk = chunk;
+                extent.numChunks = 1;
+                extent.firstPage = page;
+                mExtents.append(extent);
+            }
+            mObjectExtents.insert(objectId, qMakePair(firstExtent, mExtents.size() - firstExtent));
+        }
+
+        first = end;
+    }
+
+    mRuns.clear();
+    mRuns.squeeze();
+
+    //the extents objects had before a merge are no longer used
+    if (merged) {
+        compact();
+    }
+}
+
+//copies the extents still in use to a new list, in the order of their objects' ids
+void YaffsChunkMap::compact() {
+    QList<u32> objectIds = mObjectExtents.keys();
+    qSort(objectIds);
+
+    QVector<Extent> extents;
+    extents.reserve(mExtents.size());
+    foreach (u32 objectId, objectIds) {
+        QPair<int, int>& objectExtents = mObjectExtents[objectId];
+        int firstExtent = extents.size();
+        extents += mExtents.mid(objectExtents.first, objectExtents.second);
+        objectExtents.first = firstExtent;
+    }
+    mExtents = extents;
+}
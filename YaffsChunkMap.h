@@ -0,0 +1,78 @@
+/*
+ * yaffey: Utility for reading, editing and writing YAFFS2 images
+ * Copyright (C) 2012 David Place <david.t.place@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef YAFFSCHUNKMAP_H
+#define YAFFSCHUNKMAP_H
+
+#include <QVector>
+#include <QHash>
+#include <QPair>
+#include <QSet>
+#include <QByteArray>
+
+#include "Yaffs2.h"
+
+//Where the data chunks of each file are in the image, as runs of consecutive chunks on consecutive pages.
+//Chunks are collected while scanning or writing, then build() keeps the newest copy of each chunk.
+//Runs appended to a built map are merged into it by another build(), laid over the chunks each object already has.
+class YaffsChunkMap {
+public:
+    struct Extent {
+        u32 firstChunk;
+        u32 numChunks;
+        u32 firstPage;
+    };
+
+    YaffsChunkMap();
+
+    void addChunk(u32 objectId, u32 chunkId, u32 page, u32 sequenceNumber);
+    void addShrink(u32 objectId, u32 fileSize, u32 page, u32 sequenceNumber);
+    void append(const YaffsChunkMap& other);
+    void build();
+    void build(const QSet<u32>& objectIds);
+    void clear();
+
+    bool isEmpty() const { return mObjectExtents.isEmpty(); }
+    bool contains(u32 objectId) const { return mObjectExtents.contains(objectId); }
+    QVector<Extent> getExtents(u32 objectId) const;
+    long findPage(u32 objectId, u32 chunkId) const;
+    int memoryUsage() const;
+
+    QByteArray toByteArray() const;
+    bool fromByteArray(const QByteArray& data);
+
+private:
+    struct Run {
+        u32 objectId;
+        u32 firstChunk;
+        u32 numChunks;              //0 for a shrink, which drops the older chunks from firstChunk on
+        u32 firstPage;
+        u32 sequenceNumber;
+    };
+
+    static bool isEarlierRun(const Run& a, const Run& b);
+    void build(const QSet<u32>* objectIds);
+    void compact();
+
+private:
+    QVector<Run> mRuns;                             //collected chunks, resolved by build()
+    QVector<Extent> mExtents;                       //grouped by object, in chunk order
+    QHash<u32, QPair<int, int> > mObjectExtents;    //first extent and number of extents, by object id
+};
+
+#endif  //YAFFSCHUNKMAP_H
@@ -18,15 +18,217 @@
 
 #include <QDebug>
 
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QVector>
+#include <QSet>
+#include <QByteArray>
+
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#endif  //Q_OS_UNIX
+
 #include "YaffsControl.h"
 
-unsigned char YaffsControl::mPageData[PAGE_SIZE];
-unsigned char* YaffsControl::mChunkData = mPageData;
-unsigned char* YaffsControl::mSpareData = mPageData + CHUNK_SIZE;
+//smallest number of erase blocks worth handing to a scan worker
+#define SCAN_SEGMENT_MIN_BLOCKS 64
+
+//alignment of the page buffer, so instances on different threads never share a cache line
+#define CACHE_LINE_SIZE         64
+
+//data bytes covered by each yaffs_ecc_calc()
+#define ECC_BLOCK_SIZE          256
+#define ECC_BLOCK_BYTES         3
+
+namespace {
+    //the first is what this program has always written, the others leave bytes 0 and 1 to the bad block marker like MTD
+    const YaffsOobLayout OOB_LAYOUTS[] = {
+        { "YAFFS2 tags only",                               0,  -1, 0,   0 },
+        { "MTD, tags after the bad block marker",           2,  -1, 0,   0 },
+        { "MTD, SmartMedia data ECC in bytes 40-63",        2,  40, 256, 3 }
+    };
+
+    //unpacks the tags of numPages consecutive pages, correcting single bit errors with the tags ECC when verifying.
+    //the packed tags are copied out first, the image itself is never changed.
+    void unpackTags(const u8* pages, int numPages, int tagsOffset, bool verify, yaffs_ext_tags* tags, int& numCorrected, int& numUncorrectable) {
+        if (!verify) {
+            for (int i = 0; i < numPages; ++i) {
+                const yaffs_packed_tags2* pt = reinterpret_cast<const yaffs_packed_tags2*>(pages + i * PAGE_SIZE + CHUNK_SIZE + tagsOffset);
+                yaffs_unpack_tags2_tags_only(&tags[i], const_cast<yaffs_packed_tags2_tags_only*>(&pt->t));
+            }
+            return;
+        }
+
+        yaffs_packed_tags2 packedTags[PAGES_PER_BLOCK];
+        for (int first = 0; first < numPages; first += PAGES_PER_BLOCK) {
+            int count = qMin(numPages - first, PAGES_PER_BLOCK);
+            for (int i = 0; i < count; ++i) {
+                memcpy(&packedTags[i], pages + (first + i) * PAGE_SIZE + CHUNK_SIZE + tagsOffset, sizeof(yaffs_packed_tags2));
+            }
+
+            for (int i = 0; i < count; ++i) {
+                yaffs_ext_tags& t = tags[first + i];
+                yaffs_unpack_tags2(&t, &packedTags[i], 1);
+                if (t.ecc_result == YAFFS_ECC_RESULT_FIXED) {
+                    numCorrected++;
+                } else if (t.ecc_result == YAFFS_ECC_RESULT_UNFIXED) {
+                    numUncorrectable++;
+                    memset(&t, 0, sizeof(yaffs_ext_tags));
+                }
+            }
+        }
+    }
+
+    //whether the tags of a page say it holds the given chunk of an object
+    bool isChunkOf(const u8* page, int tagsOffset, u32 objectId, u32 chunkId) {
+        yaffs_ext_tags tags;
+        const yaffs_packed_tags2* pt = reinterpret_cast<const yaffs_packed_tags2*>(page + CHUNK_SIZE + tagsOffset);
+        yaffs_unpack_tags2_tags_only(&tags, const_cast<yaffs_packed_tags2_tags_only*>(&pt->t));
+        return (tags.chunk_used && tags.obj_id == objectId && tags.chunk_id == chunkId);
+    }
+
+    //whether the tags carry enough of a header for a tags-only scan, the root always has its header read
+    bool isHeaderInTags(const yaffs_ext_tags& tags) {
+        return (tags.extra_available && tags.obj_id != YAFFS_OBJECTID_ROOT);
+    }
+
+    //an object header found by a scan, with what's needed to tell whether it's still current
+    struct ScanRecord {
+        long headerPos;
+        yaffs_ext_tags tags;
+        int parentId;
+        int shadowsId;          //object replaced by this one when renamed over it, 0 if none
+        bool isShrink;
+        u32 fileSize;
+        QByteArray header;      //copy of the header chunk when the image isn't mapped, unless the tags stand in for it
+    };
+
+    //fills in a record from the tags, the header chunk is only looked at when the tags don't carry enough
+    void readRecordHeader(ScanRecord& record, const u8* page) {
+        const yaffs_obj_hdr* objectHeader = reinterpret_cast<const yaffs_obj_hdr*>(page);
+        const yaffs_ext_tags& tags = record.tags;
+        if (tags.extra_available) {
+            record.parentId = tags.extra_parent_id;
+            record.shadowsId = (tags.extra_shadows && objectHeader->shadows_obj > 0) ? objectHeader->shadows_obj : 0;
+            record.isShrink = (tags.extra_is_shrink != 0);
+            record.fileSize = tags.extra_file_size;
+        } else {
+            record.parentId = objectHeader->parent_obj_id;
+            record.shadowsId = (objectHeader->shadows_obj > 0) ? objectHeader->shadows_obj : 0;
+            record.isShrink = (objectHeader->type == YAFFS_OBJECT_TYPE_FILE && objectHeader->is_shrink == 1);
+            record.fileSize = objectHeader->file_size_low;
+        }
+    }
+
+    //a run of erase blocks scanned by one worker, collecting the object headers in page order.
+    //without a mapping there is a single segment, and the blocks are handed to scanBlock() as they are read.
+    class ScanSegment : public QRunnable {
+    public:
+        ScanSegment(const u8* data, long first, long end, int offset, bool verify, bool tags) :
+            imageData(data), firstPage(first), endPage(end), tagsOffset(offset), verifyTags(verify), tagsOnly(tags),
+            numTagsCorrected(0), numTagsUncorrectable(0) {
+            setAutoDelete(false);
+        }
+
+        const u8* imageData;
+        long firstPage;
+        long endPage;
+        int tagsOffset;
+        bool verifyTags;
+        bool tagsOnly;
+        QVector<ScanRecord> records;
+        YaffsChunkMap chunks;
+        int numTagsCorrected;
+        int numTagsUncorrectable;
+
+        void run() {
+            for (long block = firstPage; block < endPage; block += PAGES_PER_BLOCK) {
+                int numPages = qMin<long>(PAGES_PER_BLOCK, endPage - block);
+                scanBlock(imageData + block * PAGE_SIZE, block, numPages);
+            }
+        }
+
+        void scanBlock(const u8* pages, long blockPage, int numPages) {
+            ScanRecord record;
+            yaffs_ext_tags blockTags[PAGES_PER_BLOCK];
+            unpackTags(pages, numPages, tagsOffset, verifyTags, blockTags, numTagsCorrected, numTagsUncorrectable);
+            for (int i = 0; i < numPages; ++i) {
+                long page = blockPage + i;
+                record.tags = blockTags[i];
+                if (record.tags.chunk_used) {
+                    if (record.tags.chunk_id == 0) {
+                        const u8* pageData = pages + i * PAGE_SIZE;
+                        record.headerPos = page * PAGE_SIZE;
+                        readRecordHeader(record, pageData);
+                        if (imageData == NULL && !(tagsOnly && isHeaderInTags(record.tags))) {
+                            record.header = QByteArray(reinterpret_cast<const char*>(pageData), sizeof(yaffs_obj_hdr));
+                        } else {
+                            record.header.clear();
+                        }
+                        records.append(record);
+                    } else {
+                        chunks.addChunk(record.tags.obj_id, record.tags.chunk_id, page, record.tags.seq_number);
+                    }
+                }
+            }
+        }
+    };
+
+    //newest first: highest block sequence number, then the last page written within the block
+    bool isNewerRecord(const ScanRecord& a, const ScanRecord& b) {
+        if (a.tags.seq_number != b.tags.seq_number) {
+            return (a.tags.seq_number > b.tags.seq_number);
+        }
+        return (a.headerPos > b.headerPos);
+    }
+
+    bool isEarlierRecord(const ScanRecord& a, const ScanRecord& b) {
+        return (a.headerPos < b.headerPos);
+    }
+
+    //shrink headers cut off the chunks written before them past the new end of the file, whether they are still current or not
+    void addShrinks(const QVector<ScanRecord>& records, YaffsChunkMap& chunkMap) {
+        foreach (const ScanRecord& record, records) {
+            if (record.isShrink) {
+                chunkMap.addShrink(record.tags.obj_id, record.fileSize, record.headerPos / PAGE_SIZE, record.tags.seq_number);
+            }
+        }
+    }
+
+    //keeps only the latest header of each object that hasn't been deleted, returns how many were dropped
+    int discardObsoleteHeaders(QVector<ScanRecord>& records) {
+        qSort(records.begin(), records.end(), isNewerRecord);
+
+        QSet<u32> seenObjects;
+        QVector<ScanRecord> current;
+        foreach (const ScanRecord& record, records) {
+            if (seenObjects.contains(record.tags.obj_id)) {
+                continue;
+            }
+            seenObjects.insert(record.tags.obj_id);
+            if (record.shadowsId > 0) {
+                seenObjects.insert(record.shadowsId);
+            }
+
+            if (record.parentId != YAFFS_OBJECTID_DELETED && record.parentId != YAFFS_OBJECTID_UNLINKED) {
+                current.append(record);
+            }
+        }
+
+        int discarded = records.size() - current.size();
+        qSort(current.begin(), current.end(), isEarlierRecord);
+        records = current;
+        return discarded;
+    }
+}
 
 YaffsControl::YaffsControl(const char* imageFileName, YaffsControlObserver* observer) {
     mObserver = observer;
@@ -40,29 +242,79 @@ YaffsControl::YaffsControl(const char* imageFileName, YaffsControlObserver* obse
     }
 
     mImageFile = NULL;
+    mScanMode = SCAN_FULL;
+    mScanOrder = SCAN_FORWARD;
+    mScanThreads = QThread::idealThreadCount();
+    mVerifyTags = false;
+    mOobLayout = &OOB_LAYOUTS[0];
+    mImageMapFile = NULL;
+    mImageData = NULL;
+    mImageSize = 0;
+    mImagePos = 0;
+    mPageData = static_cast<u8*>(qMallocAligned(PAGE_SIZE, CACHE_LINE_SIZE));
+    mChunkData = mPageData;
+    mSpareData = mPageData + CHUNK_SIZE;
+    mReadChunkData = mChunkData;
+    mReadSpareData = mSpareData;
     memset(&mSaveInfo, 0, sizeof(YaffsSaveInfo));
+    mObjectId = YAFFS_NOBJECT_BUCKETS + 1;
+    mNumPages = 0;
+    mSequenceNumber = YAFFS_LOWEST_SEQUENCE_NUMBER;
+    mBlockSequence = false;
+    mWriteBuffer = NULL;
+    mWriteBatchPages = PAGES_PER_BLOCK;
+    mWritePages = 0;
+    mWriteThrough = false;
+    mWriteFailed = false;
 }
 
 YaffsControl::~YaffsControl() {
+    if (mImageMapFile) {
+        mImageMapFile->unmap(const_cast<uchar*>(mImageData));
+        delete mImageMapFile;
+    }
     if (mImageFile) {
+        flush();
         fclose(mImageFile);
     }
     delete mImageFilename;
+    qFreeAligned(mPageData);
+    qFreeAligned(mWriteBuffer);
 }
 
 bool YaffsControl::open(OpenType openType) {
     switch (openType) {
     case OPEN_READ:
         mImageFile = fopen(mImageFilename, "rb");
+        if (mImageFile) {
+            //fall back to stdio if the image can't be mapped (e.g. pipes, or no address space on 32-bit)
+            if (!mapImage()) {
+                qDebug() << "Could not map image, using buffered reads";
+
+                //the size bounds the skips over file data in processPage(), it stays 0 if the image can't seek
+                if (fseek(mImageFile, 0, SEEK_END) == 0) {
+                    mImageSize = qMax(ftell(mImageFile), 0L);
+                }
+                rewind(mImageFile);
+            }
+        }
         break;
     case OPEN_MODIFY:
         mImageFile = fopen(mImageFilename, "rb+");
+        mWriteThrough = true;
         break;
     case OPEN_NEW:
         mImageFile = fopen(mImageFilename, "wb");
         mObjectId = YAFFS_NOBJECT_BUCKETS + 1;
         mNumPages = 0;
         break;
+    case OPEN_APPEND:
+        mImageFile = fopen(mImageFilename, "rb+");
+        if (mImageFile && !startAppend()) {
+            fclose(mImageFile);
+            mImageFile = NULL;
+        }
+        break;
     }
 
     return (mImageFile != NULL);
@@ -71,11 +323,23 @@ bool YaffsControl::open(OpenType openType) {
 bool YaffsControl::readImage() {
     int result = 0;
     memset(&mReadInfo, 0, sizeof(YaffsReadInfo));
+    mReadInfo.tagsVerified = mVerifyTags;
     if (mImageFile) {
+#ifdef Q_OS_UNIX
+        //the mapping keeps the default readahead, the scan workers read it in several places at once.
+        //without a mapping the pages are read in order, skipping forward over file data.
+        if (mImageData == NULL) {
+            posix_fadvise(fileno(mImageFile), 0, 0, POSIX_FADV_SEQUENTIAL);
+        }
+#endif  //Q_OS_UNIX
+        //finding the latest header of each object takes every header in the image, so that can't skip over file data
+        if (mImageData || mScanOrder == SCAN_BACKWARDS) {
+            result = (scanImage() ? 1 : -1);
+        }
         while (result == 0) {
             result = readPage();
             if (result == -1) {
-                if (feof(mImageFile)) {
+                if (atEnd()) {
                     mReadInfo.eofHasIncompletePage = true;
                     result = 1;
                 }
@@ -90,7 +354,7 @@ bool YaffsControl::readImage() {
 }
 
 int YaffsControl::addRoot(const yaffs_obj_hdr& objectHeader, int& headerPos) {
-    headerPos = ftell(mImageFile);
+    headerPos = writePosition();
     int objectId = YAFFS_OBJECTID_ROOT;
     if (!writeHeader(objectHeader, objectId)) {
         objectId = -1;
@@ -102,7 +366,7 @@ int YaffsControl::addRoot(const yaffs_obj_hdr& objectHeader, int& headerPos) {
 }
 
 int YaffsControl::addDirectory(const yaffs_obj_hdr& objectHeader, int& headerPos) {
-    headerPos = ftell(mImageFile);
+    headerPos = writePosition();
     int objectId = mObjectId++;
     if (!writeHeader(objectHeader, objectId)) {
         objectId = -1;
@@ -113,32 +377,74 @@ int YaffsControl::addDirectory(const yaffs_obj_hdr& objectHeader, int& headerPos
     return objectId;
 }
 
-int YaffsControl::addFile(const yaffs_obj_hdr& objectHeader, int& headerPos, const char* data, int fileSize) {
-    headerPos = ftell(mImageFile);
+//copies a file of another image, chunk by chunk with copyDataPage() where it can
+int YaffsControl::addFile(const yaffs_obj_hdr& objectHeader, int& headerPos, const YaffsControl& sourceImage, const YaffsFile& sourceFile, int fileSize) {
+    headerPos = writePosition();
     int objectId = mObjectId++;
-    int chunks = (fileSize / CHUNK_SIZE);
-    int remainder = (fileSize % CHUNK_SIZE);
-    int pageGoal = chunks + (remainder > 0 ? 1 : 0);
+    int pageGoal = (fileSize + CHUNK_SIZE - 1) / CHUNK_SIZE;
     int pagesWritten = 0;
     bool wroteHeader = false;
 
     if (writeHeader(objectHeader, objectId)) {
         wroteHeader = true;
-        int chunkId = 0;
-
-        const char* dataPtr = data;
-        for (int i = 0; i < chunks; ++i) {
-            memcpy(mChunkData, dataPtr, CHUNK_SIZE);
-            if (writePage(objectId, ++chunkId, CHUNK_SIZE)) {
+        for (int chunkId = 1; chunkId <= pageGoal; ++chunkId) {
+            long offset = static_cast<long>(chunkId - 1) * CHUNK_SIZE;
+            long numBytes = qMin<long>(CHUNK_SIZE, fileSize - offset);
+            u8* page = nextWritePage();
+            if (!sourceImage.copyDataPage(sourceFile, chunkId, page, objectId, numBytes, *mOobLayout, mSequenceNumber)) {
+                //chunks never written read as zeros
+                if (sourceImage.readRange(sourceFile, offset, reinterpret_cast<char*>(page), numBytes) != numBytes) {
+                    break;
+                }
+                packDataPage(page, objectId, chunkId, numBytes, *mOobLayout, mSequenceNumber);
+            }
+            if (writePage(objectId, chunkId)) {
                 pagesWritten++;
             }
-            dataPtr += CHUNK_SIZE;
         }
+    }
+
+    if (wroteHeader && pagesWritten == pageGoal) {
+        mSaveInfo.numFilesSaved++;
+    } else {
+        mSaveInfo.numFilesFailed++;
+    }
+
+    return objectId;
+}
+
+//reads the data from source a chunk at a time, straight into the write buffer, so any size of file needs no more memory
+//than one batch of pages. the data after the current batch is already being read ahead while the batch is written.
+int YaffsControl::addFile(const yaffs_obj_hdr& objectHeader, int& headerPos, QIODevice& source, int fileSize) {
+    headerPos = writePosition();
+    int objectId = mObjectId++;
+    int pageGoal = (fileSize + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    int pagesWritten = 0;
+    bool wroteHeader = false;
+
+    qint64 sourcePos = source.pos();
+    qint64 readAhead = static_cast<qint64>(qMax(mWriteBatchPages, 1)) * CHUNK_SIZE;
+#ifdef Q_OS_UNIX
+    adviseSource(source, sourcePos, fileSize, POSIX_FADV_SEQUENTIAL);
+#endif  //Q_OS_UNIX
+
+    if (writeHeader(objectHeader, objectId)) {
+        wroteHeader = true;
+        for (int chunkId = 1; chunkId <= pageGoal; ++chunkId) {
+            long offset = static_cast<long>(chunkId - 1) * CHUNK_SIZE;
+#ifdef Q_OS_UNIX
+            if (offset % readAhead == 0) {
+                adviseSource(source, sourcePos + offset + readAhead, readAhead, POSIX_FADV_WILLNEED);
+            }
+#endif  //Q_OS_UNIX
 
-        if (remainder > 0) {
-            memset(mChunkData + remainder, 0xff, CHUNK_SIZE - remainder);
-            memcpy(mChunkData, dataPtr, remainder);
-            if (writePage(objectId, ++chunkId, remainder)) {
+            long numBytes = qMin<long>(CHUNK_SIZE, fileSize - offset);
+            u8* page = nextWritePage();
+            if (source.read(reinterpret_cast<char*>(page), numBytes) != numBytes) {
+                break;
+            }
+            packDataPage(page, objectId, chunkId, numBytes, *mOobLayout, mSequenceNumber);
+            if (writePage(objectId, chunkId)) {
                 pagesWritten++;
             }
         }
@@ -154,7 +460,7 @@ int YaffsControl::addFile(const yaffs_obj_hdr& objectHeader, int& headerPos, con
 }
 
 int YaffsControl::addSymLink(const yaffs_obj_hdr& objectHeader, int& headerPos) {
-    headerPos = ftell(mImageFile);
+    headerPos = writePosition();
     int objectId = mObjectId++;
     if (writeHeader(objectHeader, objectId)) {
         mSaveInfo.numSymLinksSaved++;
@@ -165,163 +471,776 @@ int YaffsControl::addSymLink(const yaffs_obj_hdr& objectHeader, int& headerPos)
     return objectId;
 }
 
+//the header carries the object id of the file it shares data with in equiv_id
+int YaffsControl::addHardLink(const yaffs_obj_hdr& objectHeader, int& headerPos) {
+    headerPos = writePosition();
+    int objectId = mObjectId++;
+    if (writeHeader(objectHeader, objectId)) {
+        mSaveInfo.numHardLinksSaved++;
+    } else {
+        objectId = -1;
+        mSaveInfo.numHardLinksFailed++;
+    }
+    return objectId;
+}
+
+//a newer header for an object that is already in the image
+bool YaffsControl::addObjectHeader(const yaffs_obj_hdr& objectHeader, int objectId, int& headerPos) {
+    headerPos = writePosition();
+    return writeHeader(objectHeader, objectId);
+}
+
+//deletes an object the way YAFFS2 does, with a newer header that moves it to the unlinked or deleted directory.
+//its chunks are left where they are, a scan drops them along with the object.
+bool YaffsControl::addDeletion(const yaffs_obj_hdr& objectHeader, int objectId) {
+    yaffs_obj_hdr deletedHeader = objectHeader;
+    memset(deletedHeader.name, 0, sizeof(deletedHeader.name));
+    if (objectHeader.type == YAFFS_OBJECT_TYPE_FILE) {
+        deletedHeader.parent_obj_id = YAFFS_OBJECTID_UNLINKED;
+        deletedHeader.file_size_low = 0;
+        strcpy(deletedHeader.name, "unlinked");
+    } else {
+        deletedHeader.parent_obj_id = YAFFS_OBJECTID_DELETED;
+        strcpy(deletedHeader.name, "deleted");
+    }
+    return writeHeader(deletedHeader, objectId);
+}
+
 bool YaffsControl::writeHeader(const yaffs_obj_hdr& objectHeader, u32 objectId) {
     bool result = false;
     if (mImageFile) {
-        memset(mChunkData, 0xff, CHUNK_SIZE);
-        memcpy(mChunkData, &objectHeader, sizeof(yaffs_obj_hdr));
-        result = writePage(objectId, 0, 0xffff);
+        packHeaderPage(nextWritePage(), objectHeader, objectId, *mOobLayout, mSequenceNumber);
+        result = writePage(objectId, 0);
+    }
+    return result;
+}
+
+//where the next page written will land in the image, counting pages still in the write buffer
+long YaffsControl::writePosition() {
+    return ftell(mImageFile) + static_cast<long>(mWritePages) * PAGE_SIZE;
+}
+
+//the chunk of the next page slot in the write buffer, fill it then call writePage()
+u8* YaffsControl::nextWritePage() {
+    if (mWriteBuffer == NULL) {
+        if (mWriteBatchPages < 1) {
+            mWriteBatchPages = 1;
+        }
+        mWriteBuffer = static_cast<u8*>(qMallocAligned(mWriteBatchPages * PAGE_SIZE, WRITE_BUFFER_ALIGNMENT));
+    }
+    return mWriteBuffer + mWritePages * PAGE_SIZE;
+}
+
+bool YaffsControl::flush() {
+    bool result = !mWriteFailed;
+    if (mWritePages > 0) {
+        if (fwrite(mWriteBuffer, PAGE_SIZE, mWritePages, mImageFile) != static_cast<size_t>(mWritePages)) {
+            mWriteFailed = true;
+            result = false;
+        }
+        mWritePages = 0;
     }
     return result;
 }
 
-bool YaffsControl::writePage(u32 objectId, u32 chunkId, u32 numBytes) {
+//queues the page last returned by nextWritePage(), once it has been packed
+bool YaffsControl::writePage(u32 objectId, u32 chunkId) {
     bool result = false;
 
-    static yaffs_ext_tags t;
+    //a failed batch fails every page after it as well, the image is short from there on
+    if (!mWriteFailed) {
+        mWritePages++;
+        if (mWritePages < mWriteBatchPages && !mWriteThrough) {
+            result = true;
+        } else {
+            result = flush();
+        }
+    }
+
+    if (result) {
+        mChunkMap.addChunk(objectId, chunkId, mNumPages, mSequenceNumber);
+        mNumPages++;
+        if (mBlockSequence && mNumPages % PAGES_PER_BLOCK == 0) {
+            mSequenceNumber++;
+        }
+    }
+
+    return result;
+}
+
+int YaffsControl::numOobLayouts() {
+    return sizeof(OOB_LAYOUTS) / sizeof(OOB_LAYOUTS[0]);
+}
+
+const YaffsOobLayout& YaffsControl::getOobLayout(int oobLayout) {
+    if (oobLayout < 0 || oobLayout >= numOobLayouts()) {
+        oobLayout = 0;
+    }
+    return OOB_LAYOUTS[oobLayout];
+}
+
+void YaffsControl::packHeaderPage(u8* page, const yaffs_obj_hdr& objectHeader, u32 objectId, const YaffsOobLayout& oobLayout,
+                                  u32 sequenceNumber) {
+    memset(page, 0xff, CHUNK_SIZE);
+    memcpy(page, &objectHeader, sizeof(yaffs_obj_hdr));
+    packSpare(page, objectId, 0, 0xffff, &objectHeader, oobLayout, sequenceNumber);
+}
+
+//the first numBytes of the page already hold the data
+void YaffsControl::packDataPage(u8* page, u32 objectId, u32 chunkId, u32 numBytes, const YaffsOobLayout& oobLayout,
+                                u32 sequenceNumber) {
+    memset(page + numBytes, 0xff, CHUNK_SIZE - numBytes);
+    packSpare(page, objectId, chunkId, numBytes, NULL, oobLayout, sequenceNumber);
+}
+
+//fills the spare of a page whose chunk is complete with the tags and, if the layout has it, the data ECC
+void YaffsControl::packSpare(u8* page, u32 objectId, u32 chunkId, u32 numBytes, const yaffs_obj_hdr* objectHeader, const YaffsOobLayout& oobLayout,
+                             u32 sequenceNumber) {
+    u8* spareData = page + CHUNK_SIZE;
+    memset(spareData, 0xff, SPARE_SIZE);
+    packTags(page, objectId, chunkId, numBytes, objectHeader, oobLayout, sequenceNumber);
+
+    if (oobLayout.eccOffset >= 0) {
+        for (int step = 0; step * oobLayout.eccStepSize < CHUNK_SIZE; ++step) {
+            u8* ecc = spareData + oobLayout.eccOffset + step * oobLayout.eccStepStride;
+            for (int offset = 0; offset < oobLayout.eccStepSize; offset += ECC_BLOCK_SIZE) {
+                yaffs_ecc_calc(page + step * oobLayout.eccStepSize + offset, ecc);
+                ecc += ECC_BLOCK_BYTES;
+            }
+        }
+    }
+}
+
+//packs the tags into their place in the spare, the rest of the spare is left as it is
+void YaffsControl::packTags(u8* page, u32 objectId, u32 chunkId, u32 numBytes, const yaffs_obj_hdr* objectHeader, const YaffsOobLayout& oobLayout,
+                            u32 sequenceNumber) {
+    yaffs_ext_tags t;
     memset(&t, 0, sizeof(yaffs_ext_tags));
     t.chunk_used = 1;
     t.obj_id = objectId;
     t.chunk_id = chunkId;
     t.n_bytes = numBytes;
     t.serial_number = 1;
-    t.seq_number = YAFFS_LOWEST_SEQUENCE_NUMBER;
+    t.seq_number = sequenceNumber;
+
+    //pack type, parent and size into the tags of headers, like the kernel does, so they can be scanned quickly
+    if (objectHeader) {
+        t.extra_available = 1;
+        t.extra_obj_type = objectHeader->type;
+        t.extra_parent_id = objectHeader->parent_obj_id;
+        t.extra_file_size = objectHeader->file_size_low;
+        t.extra_equiv_id = objectHeader->equiv_id;
+    }
 
-    memset(mSpareData, 0xff, SPARE_SIZE);
-    yaffs_packed_tags2* pt = reinterpret_cast<yaffs_packed_tags2*>(mSpareData);
+    yaffs_packed_tags2* pt = reinterpret_cast<yaffs_packed_tags2*>(page + CHUNK_SIZE + oobLayout.tagsOffset);
     yaffs_pack_tags2(pt, &t, 1);
+}
 
-    if (fwrite(mPageData, PAGE_SIZE, 1, mImageFile) == 1) {
-        result = true;
-        mNumPages++;
+//fills page with a data chunk of a file in this image, for the same file in another image. the chunk is copied as it is,
+//along with the data ECC when both images use the same OOB layout, and only the tags are packed again.
+//false if the chunk was never written or can't be read.
+bool YaffsControl::copyDataPage(const YaffsFile& file, u32 chunkId, u8* page, u32 objectId, u32 numBytes, const YaffsOobLayout& oobLayout,
+                                u32 sequenceNumber) const {
+    long sourcePage = findChunkPage(file, chunkId);
+    if (sourcePage == -1) {
+        return false;
     }
 
-    return result;
+    const u8* sourceData = readPageAt(sourcePage * PAGE_SIZE, page);
+    if (sourceData == NULL) {
+        return false;
+    }
+    if (mChunkMap.isEmpty() && !isChunkOf(sourceData, mOobLayout->tagsOffset, file.objectId, chunkId)) {
+        return false;
+    }
+
+    if (&oobLayout == mOobLayout) {
+        if (sourceData != page) {
+            memcpy(page, sourceData, PAGE_SIZE);
+        }
+        packTags(page, objectId, chunkId, numBytes, NULL, oobLayout, sequenceNumber);
+    } else {
+        if (sourceData != page) {
+            memcpy(page, sourceData, CHUNK_SIZE);
+        }
+        packDataPage(page, objectId, chunkId, numBytes, oobLayout, sequenceNumber);
+    }
+    return true;
 }
 
-char* YaffsControl::extractFile(int objectHeaderPos) {
-    char* data = NULL;
-    char* dataPtr;
+//writes whole pages at a page index without moving the image position, several threads can use it on one instance
+bool YaffsControl::writePagesAt(long firstPage, const u8* pages, int numPages) const {
+    bool result = false;
     if (mImageFile) {
-        if (fseek(mImageFile, objectHeaderPos, SEEK_SET) == 0) {
-            if (readPage() == 0) {
-                yaffs_packed_tags2* pt = (yaffs_packed_tags2*)mSpareData;
-                if (pt->t.n_bytes == 0xffff) {
-                    yaffs_obj_hdr* objectHeader = reinterpret_cast<yaffs_obj_hdr*>(mChunkData);
-                    if (objectHeader->file_size_low > 0) {
-                        data = new char[objectHeader->file_size_low];
-                        dataPtr = data;
-                        size_t bytesRemaining = static_cast<size_t>(objectHeader->file_size_low);
-                        size_t size = 0;
-
-                        bool success = true;
-                        int readResult;
-                        while (bytesRemaining > 0) {
-                            readResult = readPage();
-                            if (readResult == 0) {
-                                size = (bytesRemaining < pt->t.n_bytes) ? bytesRemaining : pt->t.n_bytes;
-                                void* dest = memcpy(dataPtr, mChunkData, size);
-                                if (dest != dataPtr) {
-                                    success = false;
-                                    break;
-                                }
-                                dataPtr += size;
-                            } else if (readResult == -1) {
-                                success = false;
-                                break;
-                            }
-
-                            bytesRemaining -= size;
-                        }
+        long pos = firstPage * PAGE_SIZE;
+        size_t length = static_cast<size_t>(numPages) * PAGE_SIZE;
+#ifdef Q_OS_UNIX
+        //a write can be cut short, e.g. by a signal or on a network filesystem, so it carries on until it's all written
+        size_t bytesDone = 0;
+        while (bytesDone < length) {
+            ssize_t bytesWritten = pwrite(fileno(mImageFile), pages + bytesDone, length - bytesDone, pos + bytesDone);
+            if (bytesWritten < 0 && errno == EINTR) {
+                continue;
+            }
+            if (bytesWritten <= 0) {
+                break;
+            }
+            bytesDone += bytesWritten;
+        }
+        result = (bytesDone == length);
+#else
+        QMutexLocker locker(&mFileMutex);
+        result = (fseek(mImageFile, pos, SEEK_SET) == 0 && fwrite(pages, length, 1, mImageFile) == 1);
+#endif  //Q_OS_UNIX
+    }
+    return result;
+}
 
-                        if (!success) {
-                            delete data;
-                            data = NULL;
-                        }
-                    }
+bool YaffsControl::findFile(int objectHeaderPos, YaffsFile& file) const {
+    u8 pageBuffer[PAGE_SIZE];
+    const u8* page = readPageAt(objectHeaderPos, pageBuffer);
+    if (page) {
+        yaffs_ext_tags tags;
+        const yaffs_packed_tags2* pt = reinterpret_cast<const yaffs_packed_tags2*>(page + CHUNK_SIZE + mOobLayout->tagsOffset);
+        yaffs_unpack_tags2_tags_only(&tags, const_cast<yaffs_packed_tags2_tags_only*>(&pt->t));
+
+        const yaffs_obj_hdr* objectHeader = reinterpret_cast<const yaffs_obj_hdr*>(page);
+        if (tags.chunk_used && tags.chunk_id == 0 && objectHeader->type == YAFFS_OBJECT_TYPE_FILE) {
+            file.headerPos = objectHeaderPos;
+            file.objectId = tags.obj_id;
+            file.size = objectHeader->file_size_low;
+            return true;
+        }
+    }
+    return false;
+}
+
+//with eccInfo, and a layout that has data ECC, each chunk is checked and single bit errors are corrected
+long YaffsControl::readRange(const YaffsFile& file, long offset, char* buffer, long length, YaffsEccInfo* eccInfo) const {
+    if (offset < 0 || length < 0) {
+        return -1;
+    }
+    if (offset >= file.size || length == 0) {
+        return 0;
+    }
+
+    length = qMin(length, file.size - offset);
+    adviseChunks(file, offset / CHUNK_SIZE + 1, (offset + length - 1) / CHUNK_SIZE + 1);
+
+    u8 pageBuffer[PAGE_SIZE];
+    long bytesDone = 0;
+    while (bytesDone < length) {
+        long position = offset + bytesDone;
+        u32 chunkId = position / CHUNK_SIZE + 1;
+        long chunkOffset = position % CHUNK_SIZE;
+        long size = qMin<long>(CHUNK_SIZE - chunkOffset, length - bytesDone);
+
+        long page = findChunkPage(file, chunkId);
+        if (page == -1) {
+            //chunks that were never written read as zeros, like in the kernel
+            memset(buffer + bytesDone, 0, size);
+        } else {
+            const u8* chunkData = readPageAt(page * PAGE_SIZE, pageBuffer);
+            if (chunkData == NULL) {
+                return -1;
+            }
+
+            //a page found without the chunk map is only a guess, a read that lands on some other chunk fails
+            if (mChunkMap.isEmpty() && !isChunkOf(chunkData, mOobLayout->tagsOffset, file.objectId, chunkId)) {
+                return -1;
+            }
+            if (eccInfo && mOobLayout->eccOffset >= 0) {
+                int numUncorrectable = eccInfo->numUncorrectable;
+                chunkData = checkDataEcc(chunkData, pageBuffer, *eccInfo);
+                if (eccInfo->numUncorrectable > numUncorrectable) {
+                    eccInfo->uncorrectableChunks.append(chunkId);
                 }
             }
+            memcpy(buffer + bytesDone, chunkData + chunkOffset, size);
         }
+        bytesDone += size;
     }
 
-    return data;
+    return bytesDone;
 }
 
-bool YaffsControl::updateHeader(int objectHeaderPos, const yaffs_obj_hdr& objectHeader, int objectId) {
+//the page at pos, straight from the mapping or read into pageBuffer, NULL if it can't be read
+const u8* YaffsControl::readPageAt(long pos, u8* pageBuffer) const {
+    if (mImageData) {
+        if (pos >= 0 && pos <= mImageSize - PAGE_SIZE) {
+            return mImageData + pos;
+        }
+    } else if (mImageFile) {
+#ifdef Q_OS_UNIX
+        //short reads and interruptions are carried on from, like in writePagesAt()
+        long bytesDone = 0;
+        while (bytesDone < PAGE_SIZE) {
+            ssize_t bytesRead = pread(fileno(mImageFile), pageBuffer + bytesDone, PAGE_SIZE - bytesDone, pos + bytesDone);
+            if (bytesRead < 0 && errno == EINTR) {
+                continue;
+            }
+            if (bytesRead <= 0) {
+                break;
+            }
+            bytesDone += bytesRead;
+        }
+        if (bytesDone == PAGE_SIZE) {
+            return pageBuffer;
+        }
+#else
+        QMutexLocker locker(&mFileMutex);
+        if (fseek(mImageFile, pos, SEEK_SET) == 0 && fread(pageBuffer, PAGE_SIZE, 1, mImageFile) == 1) {
+            return pageBuffer;
+        }
+#endif  //Q_OS_UNIX
+    }
+    return NULL;
+}
+
+//the page, or a corrected copy of it in pageBuffer if its data doesn't match the ECC in its spare
+const u8* YaffsControl::checkDataEcc(const u8* page, u8* pageBuffer, YaffsEccInfo& eccInfo) const {
+    const YaffsOobLayout& layout = *mOobLayout;
+    u8* corrected = NULL;
+    for (int step = 0; step * layout.eccStepSize < CHUNK_SIZE; ++step) {
+        for (int offset = 0; offset < layout.eccStepSize; offset += ECC_BLOCK_SIZE) {
+            int dataOffset = step * layout.eccStepSize + offset;
+            const u8* readEcc = page + CHUNK_SIZE + layout.eccOffset + step * layout.eccStepStride + (offset / ECC_BLOCK_SIZE) * ECC_BLOCK_BYTES;
+            u8 testEcc[ECC_BLOCK_BYTES];
+            yaffs_ecc_calc((corrected ? corrected : page) + dataOffset, testEcc);
+            if (memcmp(readEcc, testEcc, ECC_BLOCK_BYTES) == 0) {
+                continue;
+            }
+
+            //the mapping is read-only, corrections go into a copy
+            if (corrected == NULL) {
+                if (page != pageBuffer) {
+                    memcpy(pageBuffer, page, PAGE_SIZE);
+                }
+                corrected = pageBuffer;
+            }
+
+            u8 eccCopy[ECC_BLOCK_BYTES];
+            memcpy(eccCopy, readEcc, ECC_BLOCK_BYTES);
+            int result = yaffs_ecc_correct(corrected + dataOffset, eccCopy, testEcc);
+            if (result == 1) {
+                eccInfo.numCorrected++;
+            } else if (result == -1) {
+                eccInfo.numUncorrectable++;
+            }
+        }
+    }
+    return (corrected ? corrected : page);
+}
+
+//page index of a chunk of a file, or -1 if the chunk doesn't exist
+long YaffsControl::findChunkPage(const YaffsFile& file, u32 chunkId) const {
+    if (!mChunkMap.isEmpty()) {
+        return mChunkMap.findPage(file.objectId, chunkId);
+    }
+
+    //without a chunk map the data is expected to follow the header, the way this program writes images.
+    //the callers fail the read if the page is past the end or its tags say it holds some other chunk.
+    return file.headerPos / PAGE_SIZE + chunkId;
+}
+
+void YaffsControl::adviseChunks(const YaffsFile& file, u32 firstChunk, u32 lastChunk) const {
+#ifdef Q_OS_UNIX
+    if (mImageData) {
+        if (mChunkMap.isEmpty()) {
+            long firstPage = findChunkPage(file, firstChunk);
+            adviseRange(firstPage * PAGE_SIZE, (lastChunk - firstChunk + 1) * PAGE_SIZE, POSIX_MADV_WILLNEED);
+        } else {
+            foreach (const YaffsChunkMap::Extent& extent, mChunkMap.getExtents(file.objectId)) {
+                if (extent.firstChunk <= lastChunk && extent.firstChunk + extent.numChunks > firstChunk) {
+                    adviseRange(static_cast<long>(extent.firstPage) * PAGE_SIZE, extent.numChunks * PAGE_SIZE, POSIX_MADV_WILLNEED);
+                }
+            }
+        }
+    }
+#else
+    Q_UNUSED(file);
+    Q_UNUSED(firstChunk);
+    Q_UNUSED(lastChunk);
+#endif  //Q_OS_UNIX
+}
+
+bool YaffsControl::readHeader(int objectHeaderPos, yaffs_obj_hdr& objectHeader) {
     bool result = false;
     if (mImageFile) {
-        if (fseek(mImageFile, objectHeaderPos, SEEK_SET) == 0) {
-            result = writeHeader(objectHeader, objectId);
-            if (result) {
-                qDebug() << "Wrote header at: " << objectHeaderPos;
-            } else {
-                qDebug() << "Failed to write header";
+        if (seek(objectHeaderPos)) {
+            if (readPage() == 0) {
+                yaffs_ext_tags tags;
+                readTags(tags);
+                if (tags.chunk_used && tags.chunk_id == 0) {
+                    memcpy(&objectHeader, mReadChunkData, sizeof(yaffs_obj_hdr));
+                    result = true;
+                }
             }
         }
     }
     return result;
 }
 
+//rewrites the header page of an object in place. the tags and ECC are packed again, keeping the sequence number
+//of the block so that a scan still finds the header where it was.
+bool YaffsControl::updateHeader(int objectHeaderPos, const yaffs_obj_hdr& objectHeader, int objectId) {
+    bool result = false;
+
+    //the page read back has to see the headers written before it
+    if (mImageFile && fflush(mImageFile) == 0) {
+        const u8* page = readPageAt(objectHeaderPos, mPageData);
+        if (page) {
+            const yaffs_packed_tags2* pt = reinterpret_cast<const yaffs_packed_tags2*>(page + CHUNK_SIZE + mOobLayout->tagsOffset);
+            yaffs_ext_tags tags;
+            yaffs_unpack_tags2_tags_only(&tags, const_cast<yaffs_packed_tags2_tags_only*>(&pt->t));
+
+            //refuse to overwrite anything but the header of the same object
+            if (tags.chunk_used && tags.obj_id == static_cast<u32>(objectId) && tags.chunk_id == 0 &&
+                    fseek(mImageFile, objectHeaderPos, SEEK_SET) == 0) {
+                packHeaderPage(nextWritePage(), objectHeader, objectId, *mOobLayout, tags.seq_number);
+                result = writePage(objectId, 0);
+            }
+        }
+    }
+
+    if (result) {
+        qDebug() << "Wrote header at: " << objectHeaderPos;
+    } else {
+        qDebug() << "Failed to write header at: " << objectHeaderPos;
+    }
+    return result;
+}
+
+//appending starts in a fresh erase block after the last one used, the partly used last block is padded with erased pages.
+//the blocks written get sequence numbers above every one in the image, so a scan takes what they hold as the newest state.
+bool YaffsControl::startAppend() {
+    if (fseek(mImageFile, 0, SEEK_END) != 0) {
+        return false;
+    }
+
+    //a torn page at the end would put every page after it out of line
+    long size = ftell(mImageFile);
+    if (size < 0 || size % PAGE_SIZE != 0) {
+        qDebug() << "Can't append to an image that ends in a partial page";
+        return false;
+    }
+
+    //every page of a block carries the block's sequence number, so the first page of each is enough
+    long numPages = size / PAGE_SIZE;
+    u32 highestSequenceNumber = YAFFS_LOWEST_SEQUENCE_NUMBER - 1;
+    for (long page = 0; page < numPages; page += PAGES_PER_BLOCK) {
+        const u8* pageData = readPageAt(page * PAGE_SIZE, mPageData);
+        if (pageData == NULL) {
+            return false;
+        }
+
+        yaffs_ext_tags tags;
+        const yaffs_packed_tags2* pt = reinterpret_cast<const yaffs_packed_tags2*>(pageData + CHUNK_SIZE + mOobLayout->tagsOffset);
+        yaffs_unpack_tags2_tags_only(&tags, const_cast<yaffs_packed_tags2_tags_only*>(&pt->t));
+        if (tags.chunk_used && tags.seq_number > highestSequenceNumber) {
+            highestSequenceNumber = tags.seq_number;
+        }
+    }
+
+    if (fseek(mImageFile, 0, SEEK_END) != 0) {
+        return false;
+    }
+
+    memset(mPageData, 0xff, PAGE_SIZE);
+    while (numPages % PAGES_PER_BLOCK != 0) {
+        if (fwrite(mPageData, PAGE_SIZE, 1, mImageFile) != 1) {
+            return false;
+        }
+        numPages++;
+    }
+
+    mNumPages = numPages;
+    mSequenceNumber = highestSequenceNumber + 1;
+    mBlockSequence = true;
+    return true;
+}
+
+bool YaffsControl::mapImage() {
+    mImageMapFile = new QFile(QString::fromLocal8Bit(mImageFilename));
+    if (mImageMapFile->open(QIODevice::ReadOnly)) {
+        qint64 size = mImageMapFile->size();
+        if (size > 0 && size == static_cast<long>(size)) {
+            mImageData = mImageMapFile->map(0, size);
+            if (mImageData) {
+                mImageSize = static_cast<long>(size);
+                mImagePos = 0;
+                return true;
+            }
+        }
+    }
+
+    delete mImageMapFile;
+    mImageMapFile = NULL;
+    return false;
+}
+
+//passes a hint about how a file being added will be read on to the kernel, for sources that are plain files
+void YaffsControl::adviseSource(QIODevice& source, qint64 pos, qint64 length, int advice) {
+#ifdef Q_OS_UNIX
+    QFile* file = qobject_cast<QFile*>(&source);
+    if (file && file->handle() != -1 && length > 0) {
+        posix_fadvise(file->handle(), pos, length, advice);
+    }
+#else
+    Q_UNUSED(source);
+    Q_UNUSED(pos);
+    Q_UNUSED(length);
+    Q_UNUSED(advice);
+#endif  //Q_OS_UNIX
+}
+
+void YaffsControl::adviseRange(long pos, long length, int advice) const {
+#ifdef Q_OS_UNIX
+    if (mImageData && pos < mImageSize && length > 0) {
+        //madvise wants a page aligned address, the mapping itself starts on a page boundary
+        long pageSize = sysconf(_SC_PAGESIZE);
+        long start = pos - (pos % pageSize);
+        long end = qMin(pos + length, mImageSize);
+        posix_madvise(const_cast<u8*>(mImageData) + start, end - start, advice);
+    }
+#else
+    Q_UNUSED(pos);
+    Q_UNUSED(length);
+    Q_UNUSED(advice);
+#endif  //Q_OS_UNIX
+}
+
+long YaffsControl::tell() {
+    if (mImageData) {
+        return mImagePos;
+    }
+    return ftell(mImageFile);
+}
+
+bool YaffsControl::seek(long pos) {
+    if (mImageData) {
+        //like fseek, seeking past the end is allowed and the next read hits the end of the image
+        if (pos >= 0) {
+            mImagePos = qMin(pos, mImageSize);
+            return true;
+        }
+        return false;
+    }
+    return (fseek(mImageFile, pos, SEEK_SET) == 0);
+}
+
+bool YaffsControl::atEnd() {
+    if (mImageData) {
+        return (mImagePos >= mImageSize);
+    }
+    return (feof(mImageFile) != 0);
+}
+
 int YaffsControl::readPage() {
     int result = 0;
-    memset(mPageData, 0, PAGE_SIZE);
-    size_t bytesRead = fread(mPageData, 1, PAGE_SIZE, mImageFile);
-    if (bytesRead != PAGE_SIZE) {
-        if (bytesRead == 0) {
+    if (mImageData) {
+        long bytesLeft = mImageSize - mImagePos;
+        if (bytesLeft >= PAGE_SIZE) {
+            mReadChunkData = mImageData + mImagePos;
+            mReadSpareData = mReadChunkData + CHUNK_SIZE;
+            mImagePos += PAGE_SIZE;
+        } else if (bytesLeft <= 0) {
             result = 1;     //end of image
         } else {
+            mImagePos = mImageSize;
             result = -1;    //error
         }
+    } else {
+        memset(mPageData, 0, PAGE_SIZE);
+        mReadChunkData = mChunkData;
+        mReadSpareData = mSpareData;
+        size_t bytesRead = fread(mPageData, 1, PAGE_SIZE, mImageFile);
+        if (bytesRead != PAGE_SIZE) {
+            if (bytesRead == 0) {
+                result = 1;     //end of image
+            } else {
+                result = -1;    //error
+            }
+        }
     }
     return result;
 }
 
+void YaffsControl::readTags(yaffs_ext_tags& tags) const {
+    const yaffs_packed_tags2* pt = reinterpret_cast<const yaffs_packed_tags2*>(mReadSpareData + mOobLayout->tagsOffset);
+    yaffs_unpack_tags2_tags_only(&tags, const_cast<yaffs_packed_tags2_tags_only*>(&pt->t));
+}
+
+//reads the tags of every page, with a mapping in parallel, and reports the headers found in image order
+bool YaffsControl::scanImage() {
+    QList<ScanSegment*> segments;
+    if (mImageData) {
+        long numPages = mImageSize / PAGE_SIZE;
+        long numBlocks = (numPages + PAGES_PER_BLOCK - 1) / PAGES_PER_BLOCK;
+
+        //large images are split into a few segments per thread so that uneven segments still balance out
+        long blocksPerSegment = numBlocks;
+        if (mScanThreads > 1 && numBlocks >= 2 * SCAN_SEGMENT_MIN_BLOCKS) {
+            blocksPerSegment = qMax<long>(numBlocks / (mScanThreads * 4), SCAN_SEGMENT_MIN_BLOCKS);
+        }
+
+        for (long block = 0; block < numBlocks; block += blocksPerSegment) {
+            long endPage = qMin((block + blocksPerSegment) * PAGES_PER_BLOCK, numPages);
+            segments.append(new ScanSegment(mImageData, block * PAGES_PER_BLOCK, endPage, mOobLayout->tagsOffset, mVerifyTags,
+                                            mScanMode == SCAN_TAGS_ONLY));
+        }
+
+        if (segments.size() > 1) {
+            QThreadPool pool;
+            pool.setMaxThreadCount(mScanThreads);
+            foreach (ScanSegment* segment, segments) {
+                pool.start(segment);
+            }
+            pool.waitForDone();
+        } else if (segments.size() == 1) {
+            segments.first()->run();
+        }
+
+        if (mImageSize % PAGE_SIZE != 0) {
+            mReadInfo.eofHasIncompletePage = true;
+        }
+        mImagePos = mImageSize;
+    } else {
+        //read a block at a time, the way the image was written
+        ScanSegment* segment = new ScanSegment(NULL, 0, 0, mOobLayout->tagsOffset, mVerifyTags, mScanMode == SCAN_TAGS_ONLY);
+        segments.append(segment);
+
+        const size_t blockSize = PAGES_PER_BLOCK * PAGE_SIZE;
+        u8* blockData = new u8[blockSize];
+        long page = 0;
+        size_t bytesRead = blockSize;
+        while (bytesRead == blockSize) {
+            bytesRead = fread(blockData, 1, blockSize, mImageFile);
+            int numPages = bytesRead / PAGE_SIZE;
+            segment->scanBlock(blockData, page, numPages);
+            page += numPages;
+        }
+        delete [] blockData;
+
+        if (ferror(mImageFile)) {
+            qDeleteAll(segments);
+            return false;
+        }
+        if (bytesRead % PAGE_SIZE != 0) {
+            mReadInfo.eofHasIncompletePage = true;
+        }
+    }
+
+    QVector<ScanRecord> records;
+    mChunkMap.clear();
+    foreach (const ScanSegment* segment, segments) {
+        records += segment->records;
+        mChunkMap.append(segment->chunks);
+        mReadInfo.numTagsCorrected += segment->numTagsCorrected;
+        mReadInfo.numTagsUncorrectable += segment->numTagsUncorrectable;
+    }
+    qDeleteAll(segments);
+    addShrinks(records, mChunkMap);
+
+    if (mScanOrder == SCAN_BACKWARDS) {
+        mReadInfo.numObsoleteHeaders = discardObsoleteHeaders(records);
+    }
+
+    //chunks of deleted objects and chunks rewritten later are left out
+    QSet<u32> objectIds;
+    foreach (const ScanRecord& record, records) {
+        objectIds.insert(record.tags.obj_id);
+    }
+    mChunkMap.build(objectIds);
+
+    //hand the objects to the observer in image order, the same whatever the number of segments
+    foreach (const ScanRecord& record, records) {
+        const u8* chunkData = reinterpret_cast<const u8*>(record.header.isEmpty() ? NULL : record.header.constData());
+        if (mImageData) {
+            chunkData = mImageData + record.headerPos;
+        }
+        processHeader(record.tags, record.headerPos, chunkData);
+    }
+    return true;
+}
+
 void YaffsControl::processPage() {
-    yaffs_packed_tags2* pt = (yaffs_packed_tags2*)mSpareData;
+    yaffs_ext_tags tags;
+    unpackTags(mReadChunkData, 1, mOobLayout->tagsOffset, mVerifyTags, &tags, mReadInfo.numTagsCorrected, mReadInfo.numTagsUncorrectable);
 
-    if (pt->t.n_bytes == 0xffff) {       //a new object
-        yaffs_obj_hdr* objectHeader = reinterpret_cast<yaffs_obj_hdr*>(mChunkData);
+    if (tags.chunk_used && tags.chunk_id == 0) {       //a new object
+        long headerPos = tell() - PAGE_SIZE;
+        long fileSize = processHeader(tags, headerPos, mReadChunkData);
 
-        switch (objectHeader->type) {
-            case YAFFS_OBJECT_TYPE_FILE:
-                mReadInfo.numFiles++;
-                break;
-            case YAFFS_OBJECT_TYPE_SYMLINK:
-                mReadInfo.numSymLinks++;
-                break;
-            case YAFFS_OBJECT_TYPE_DIRECTORY:
-                mReadInfo.numDirs++;
-                break;
-            case YAFFS_OBJECT_TYPE_HARDLINK:
-                mReadInfo.numHardLinks++;
-                break;
-            case YAFFS_OBJECT_TYPE_UNKNOWN:
-                mReadInfo.numUnknowns++;
-                break;
-            case YAFFS_OBJECT_TYPE_SPECIAL:
-                mReadInfo.numSpecials++;
-                break;
-            default:
+        //skip over the chunks for the file data. a size that runs past the end of the image means a damaged
+        //header, the pages after it are scanned one by one instead so that no header behind it is skipped.
+        if (fileSize > 0) {
+            long pages = (fileSize + CHUNK_SIZE - 1) / CHUNK_SIZE;
+            if (mImageSize > 0 && pages > (mImageSize - headerPos) / PAGE_SIZE - 1) {
                 mReadInfo.numErrorousObjects++;
-                break;
+            } else {
+                seek(headerPos + PAGE_SIZE + pages * PAGE_SIZE);
+            }
         }
+    }
+}
 
-        if (objectHeader->type == YAFFS_OBJECT_TYPE_FILE ||
-                objectHeader->type == YAFFS_OBJECT_TYPE_DIRECTORY ||
-                objectHeader->type == YAFFS_OBJECT_TYPE_SYMLINK) {
+long YaffsControl::processHeader(const yaffs_ext_tags& tags, long headerPos, const u8* chunkData) {
+    const yaffs_obj_hdr* objectHeader = reinterpret_cast<const yaffs_obj_hdr*>(chunkData);
+    bool headerLoaded = true;
+    long fileSize = 0;
 
-            //calculate header position to pass to observer
-            long headerPos = ftell(mImageFile) - PAGE_SIZE;
+    //the header chunk is left untouched if the tags describe the object well enough. without a mapping the scan
+    //doesn't keep a copy of it either, and when reading page by page it was read anyway but is still left for later
+    //so that the objects reported are the same however the image is read.
+    yaffs_obj_hdr tagsHeader;
+    if (mScanMode == SCAN_TAGS_ONLY && isHeaderInTags(tags)) {
+        memset(&tagsHeader, 0, sizeof(yaffs_obj_hdr));
+        tagsHeader.type = tags.extra_obj_type;
+        tagsHeader.parent_obj_id = tags.extra_parent_id;
+        tagsHeader.file_size_low = tags.extra_file_size;
+        tagsHeader.equiv_id = tags.extra_equiv_id;
+        objectHeader = &tagsHeader;
+        headerLoaded = false;
+    }
 
-            //skip over the chunks for the file data
-            if (objectHeader->type == YAFFS_OBJECT_TYPE_FILE) {
-                int pagePadding = PAGE_SIZE - (objectHeader->file_size_low % PAGE_SIZE);
-                fseek(mImageFile, objectHeader->file_size_low + pagePadding, SEEK_CUR);
-            }
+    switch (objectHeader->type) {
+        case YAFFS_OBJECT_TYPE_FILE:
+            mReadInfo.numFiles++;
+            break;
+        case YAFFS_OBJECT_TYPE_SYMLINK:
+            mReadInfo.numSymLinks++;
+            break;
+        case YAFFS_OBJECT_TYPE_DIRECTORY:
+            mReadInfo.numDirs++;
+            break;
+        case YAFFS_OBJECT_TYPE_HARDLINK:
+            mReadInfo.numHardLinks++;
+            break;
+        case YAFFS_OBJECT_TYPE_UNKNOWN:
+            mReadInfo.numUnknowns++;
+            break;
+        case YAFFS_OBJECT_TYPE_SPECIAL:
+            mReadInfo.numSpecials++;
+            break;
+        default:
+            mReadInfo.numErrorousObjects++;
+            break;
+    }
 
-            if (mObserver) {
-                mObserver->newItem(pt->t.obj_id, objectHeader, headerPos);
-            }
+    if (objectHeader->type == YAFFS_OBJECT_TYPE_FILE ||
+            objectHeader->type == YAFFS_OBJECT_TYPE_DIRECTORY ||
+            objectHeader->type == YAFFS_OBJECT_TYPE_SYMLINK ||
+            objectHeader->type == YAFFS_OBJECT_TYPE_HARDLINK) {
+
+        if (objectHeader->type == YAFFS_OBJECT_TYPE_FILE) {
+            fileSize = objectHeader->file_size_low;
+        }
+
+        if (mObserver) {
+            mObserver->newItem(tags.obj_id, objectHeader, headerPos, headerLoaded);
         }
     }
+
+    return fileSize;
 }
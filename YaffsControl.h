@@ -19,11 +19,20 @@
 #ifndef YAFFSREADER_H
 #define YAFFSREADER_H
 
+#include <QFile>
+#include <QMutex>
+#include <QList>
+
 #include "Yaffs2.h"
+#include "YaffsChunkMap.h"
+
+//alignment of the buffers pages are written from, a multiple of the memory page size so large writes can skip a copy
+#define WRITE_BUFFER_ALIGNMENT  4096
 
 class YaffsControlObserver {
 public:
-    virtual void newItem(int yaffsObjectId, const yaffs_obj_hdr* objectHeader, int fileOffset) = 0;
+    //headerLoaded is false when only the fields carried in the tags are filled in
+    virtual void newItem(int yaffsObjectId, const yaffs_obj_hdr* objectHeader, int fileOffset, bool headerLoaded) = 0;
     virtual void readComplete() = 0;
 };
 
@@ -37,6 +46,35 @@ struct YaffsReadInfo {
     int numUnknowns;
     int numSpecials;
     int numErrorousObjects;
+    int numObsoleteHeaders;
+    bool tagsVerified;
+    int numTagsCorrected;
+    int numTagsUncorrectable;       //pages whose tags couldn't be trusted, they are left out
+};
+
+//where the tags and the data ECC go in the spare area of each page, the layouts are listed by YaffsControl::getOobLayout()
+struct YaffsOobLayout {
+    const char* name;
+    int tagsOffset;
+    int eccOffset;          //spare byte of the first step's ECC, -1 for no data ECC
+    int eccStepSize;        //data bytes per step, a multiple of the 256 bytes each 3 ECC bytes cover
+    int eccStepStride;      //spare bytes from one step's ECC to the next
+};
+
+//a file found by YaffsControl::findFile(), for reading it with readRange()
+struct YaffsFile {
+    long headerPos;
+    u32 objectId;
+    long size;
+};
+
+//data ECC results of readRange(), counted per 256 byte step
+struct YaffsEccInfo {
+    YaffsEccInfo() : numCorrected(0), numUncorrectable(0) {}
+
+    int numCorrected;
+    int numUncorrectable;       //left as read
+    QList<u32> uncorrectableChunks;     //chunk ids of the file holding data left as read, in the order read
 };
 
 struct YaffsSaveInfo {
@@ -47,14 +85,31 @@ struct YaffsSaveInfo {
     int numDirsFailed;
     int numSymLinksSaved;
     int numSymLinksFailed;
+    int numHardLinksSaved;
+    int numHardLinksFailed;
 };
 
+//Every instance has its own page buffers, so any number of instances can be used at once.
+//A single instance is not thread-safe, except for findFile() and readRange(const YaffsFile&, ...)
+//which several threads may call together on an instance opened with OPEN_READ, and writePagesAt()
+//which they may call together on one opened with OPEN_NEW.
 class YaffsControl {
 public:
     enum OpenType {
         OPEN_READ,
         OPEN_MODIFY,
-        OPEN_NEW
+        OPEN_NEW,
+        OPEN_APPEND         //new pages go in fresh erase blocks after the image, with higher sequence numbers
+    };
+
+    enum ScanMode {
+        SCAN_FULL,          //read the object header chunk of every object
+        SCAN_TAGS_ONLY      //use the extra header info in the tags where present, headers are read later
+    };
+
+    enum ScanOrder {
+        SCAN_FORWARD,       //every object header found is reported
+        SCAN_BACKWARDS      //newest blocks first by sequence number, only the latest header of live objects is reported
     };
 
     YaffsControl(const char* imageFileName, YaffsControlObserver* observer);
@@ -62,20 +117,70 @@ public:
 
     bool open(OpenType openType);
     bool readImage();
+    void setScanMode(ScanMode scanMode) { mScanMode = scanMode; }
+    void setScanOrder(ScanOrder scanOrder) { mScanOrder = scanOrder; }
+    void setScanThreads(int scanThreads) { mScanThreads = scanThreads; }
+    void setVerifyTags(bool verifyTags) { mVerifyTags = verifyTags; }      //check and correct the tags with their ECC
+    void setOobLayout(int oobLayout) { mOobLayout = &getOobLayout(oobLayout); }
+    void setChunkMap(const YaffsChunkMap& chunkMap) { mChunkMap = chunkMap; }
+    void setWriteBatchPages(int writeBatchPages) { mWriteBatchPages = writeBatchPages; }    //before the first write
+    void setNextObjectId(int objectId) { mObjectId = objectId; }       //when appending, above every id in the image
+    const YaffsChunkMap& getChunkMap() const { return mChunkMap; }
+    bool readHeader(int objectHeaderPos, yaffs_obj_hdr& objectHeader);
     YaffsReadInfo getReadInfo() { return mReadInfo; }
     YaffsSaveInfo getSaveInfo() { return mSaveInfo; }
-    char* extractFile(int objectHeaderPos);
-    bool updateHeader(int objectHeaderPos, const yaffs_obj_hdr& objectHeader, int objectId);
+    //positional reads that don't move the image position, several threads can use them on one open instance.
+    //YaffsFileDevice streams a file through them.
+    bool findFile(int objectHeaderPos, YaffsFile& file) const;
+    long readRange(const YaffsFile& file, long offset, char* buffer, long length, YaffsEccInfo* eccInfo = NULL) const;
+    bool updateHeader(int objectHeaderPos, const yaffs_obj_hdr& objectHeader, int objectId);       //on an instance opened with OPEN_MODIFY
 
     int addRoot(const yaffs_obj_hdr& objectHeader, int& headerPos);
     int addDirectory(const yaffs_obj_hdr& objectHeader, int& headerPos);
-    int addFile(const yaffs_obj_hdr& objectHeader, int& headerPos, const char* data, int fileSize);
+    int addFile(const yaffs_obj_hdr& objectHeader, int& headerPos, const YaffsControl& sourceImage, const YaffsFile& sourceFile, int fileSize);
+    int addFile(const yaffs_obj_hdr& objectHeader, int& headerPos, QIODevice& source, int fileSize);
     int addSymLink(const yaffs_obj_hdr& objectHeader, int& headerPos);
+    int addHardLink(const yaffs_obj_hdr& objectHeader, int& headerPos);
+    bool addObjectHeader(const yaffs_obj_hdr& objectHeader, int objectId, int& headerPos);
+    bool addDeletion(const yaffs_obj_hdr& objectHeader, int objectId);
+    bool flush();
+
+    static int numOobLayouts();
+    static const YaffsOobLayout& getOobLayout(int oobLayout);
+
+    //pages laid out by the caller, see YaffsWriter
+    static void packHeaderPage(u8* page, const yaffs_obj_hdr& objectHeader, u32 objectId, const YaffsOobLayout& oobLayout,
+                               u32 sequenceNumber = YAFFS_LOWEST_SEQUENCE_NUMBER);
+    static void packDataPage(u8* page, u32 objectId, u32 chunkId, u32 numBytes, const YaffsOobLayout& oobLayout,
+                             u32 sequenceNumber = YAFFS_LOWEST_SEQUENCE_NUMBER);
+    bool writePagesAt(long firstPage, const u8* pages, int numPages) const;
+    bool copyDataPage(const YaffsFile& file, u32 chunkId, u8* page, u32 objectId, u32 numBytes, const YaffsOobLayout& oobLayout,
+                      u32 sequenceNumber = YAFFS_LOWEST_SEQUENCE_NUMBER) const;
 
 private:
+    bool mapImage();
+    bool startAppend();
+    void adviseRange(long pos, long length, int advice) const;
+    static void adviseSource(QIODevice& source, qint64 pos, qint64 length, int advice);
+    long tell();
+    bool seek(long pos);
+    bool atEnd();
     int readPage();
+    const u8* readPageAt(long pos, u8* pageBuffer) const;
+    long findChunkPage(const YaffsFile& file, u32 chunkId) const;
+    const u8* checkDataEcc(const u8* page, u8* pageBuffer, YaffsEccInfo& eccInfo) const;
+    void adviseChunks(const YaffsFile& file, u32 firstChunk, u32 lastChunk) const;
+    void readTags(yaffs_ext_tags& tags) const;
+    bool scanImage();
     void processPage();
-    bool writePage(u32 objectId, u32 chunkId, u32 numBytes);
+    long processHeader(const yaffs_ext_tags& tags, long headerPos, const u8* chunkData);
+    long writePosition();
+    u8* nextWritePage();
+    bool writePage(u32 objectId, u32 chunkId);
+    static void packTags(u8* page, u32 objectId, u32 chunkId, u32 numBytes, const yaffs_obj_hdr* objectHeader, const YaffsOobLayout& oobLayout,
+                         u32 sequenceNumber);
+    static void packSpare(u8* page, u32 objectId, u32 chunkId, u32 numBytes, const yaffs_obj_hdr* objectHeader, const YaffsOobLayout& oobLayout,
+                          u32 sequenceNumber);
     bool writeHeader(const yaffs_obj_hdr& objectHeader, u32 objectId);
 
 private:
@@ -83,14 +188,43 @@ private:
     char* mImageFilename;
     FILE* mImageFile;
 
+    //read-only mapping of the image, used instead of mImageFile when available
+    QFile* mImageMapFile;
+    const u8* mImageData;
+    long mImageSize;
+    long mImagePos;
+
+    //point at the page last returned by readPage(), either in the mapping or in mPageData
+    const u8* mReadChunkData;
+    const u8* mReadSpareData;
+
+    ScanMode mScanMode;
+    ScanOrder mScanOrder;
+    int mScanThreads;
+    bool mVerifyTags;
+    const YaffsOobLayout* mOobLayout;
     YaffsReadInfo mReadInfo;
     YaffsSaveInfo mSaveInfo;
-    static u8 mPageData[];
-    static u8* mChunkData;
-    static u8* mSpareData;
+    YaffsChunkMap mChunkMap;        //built by readImage() or while writing, or set from an earlier scan
+    u8* mPageData;                  //one page, cache line aligned
+    u8* mChunkData;
+    u8* mSpareData;
 
     int mObjectId;
     int mNumPages;
+    u32 mSequenceNumber;            //of the block being written
+    bool mBlockSequence;            //each new erase block gets the next sequence number, as YAFFS2 does
+
+    //pages are assembled here and written out a batch at a time, by default one erase block
+    u8* mWriteBuffer;
+    int mWriteBatchPages;
+    int mWritePages;                //pages waiting in mWriteBuffer
+    bool mWriteThrough;             //OPEN_MODIFY writes each page in place straight away
+    bool mWriteFailed;
+
+    mutable QMutex mFileMutex;      //for positional reads and writes without pread() and pwrite()
+
+    Q_DISABLE_COPY(YaffsControl)
 };
 
 #endif  //YAFFSREADER_H
@@ -0,0 +1,47 @@
+/*
+ * yaffey: Utility for reading, editing and writing YAFFS2 images
+ * Copyright (C) 2012 David Place <david.t.place@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "YaffsFileDevice.h"
+
+YaffsFileDevice::YaffsFileDevice(const YaffsControl& image, const YaffsFile& file, YaffsEccInfo* eccInfo, QObject* parent) :
+    QIODevice(parent), mImage(image), mFile(file), mEccInfo(eccInfo) {
+}
+
+bool YaffsFileDevice::open(OpenMode mode) {
+    if (mode & (WriteOnly | Append | Truncate)) {
+        return false;
+    }
+    //reads go straight into the caller's buffer
+    return QIODevice::open(mode | Unbuffered);
+}
+
+qint64 YaffsFileDevice::readData(char* data, qint64 maxSize) {
+    qint64 position = pos();
+    if (position >= mFile.size) {
+        return 0;
+    }
+
+    long length = static_cast<long>(qMin<qint64>(maxSize, mFile.size - position));
+    return mImage.readRange(mFile, static_cast<long>(position), data, length, mEccInfo);
+}
+
+qint64 YaffsFileDevice::writeData(const char* data, qint64 maxSize) {
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+    return -1;
+}
@@ -0,0 +1,51 @@
+/*
+ * yaffey: Utility for reading, editing and writing YAFFS2 images
+ * Copyright (C) 2012 David Place <david.t.place@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef YAFFSFILEDEVICE_H
+#define YAFFSFILEDEVICE_H
+
+#include <QIODevice>
+
+#include "YaffsControl.h"
+
+//Read-only QIODevice over one file inside an image, so it can be streamed instead of extracted whole.
+//It reads through an image opened elsewhere with OPEN_READ, so several devices on different threads can share one.
+class YaffsFileDevice : public QIODevice {
+    Q_OBJECT
+
+public:
+    //with eccInfo the data ECC is checked as the file is read, and the results are added to it
+    YaffsFileDevice(const YaffsControl& image, const YaffsFile& file, YaffsEccInfo* eccInfo = NULL, QObject* parent = 0);
+
+    //from QIODevice
+    bool open(OpenMode mode);
+    bool isSequential() const { return false; }
+    qint64 size() const { return mFile.size; }
+
+protected:
+    //from QIODevice
+    qint64 readData(char* data, qint64 maxSize);
+    qint64 writeData(const char* data, qint64 maxSize);
+
+private:
+    const YaffsControl& mImage;
+    YaffsFile mFile;
+    YaffsEccInfo* mEccInfo;
+};
+
+#endif  //YAFFSFILEDEVICE_H
@@ -0,0 +1,164 @@
+/*
+ * yaffey: Utility for reading, editing and writing YAFFS2 images
+ * Copyright (C) 2012 David Place <david.t.place@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QThread>
+#include <QRunnable>
+
+#ifdef Q_OS_UNIX
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <string.h>
+#endif  //Q_OS_UNIX
+
+#include "YaffsImporter.h"
+
+//progress is reported after each directory, but not more often than once per this many items
+#define PROGRESS_INTERVAL       256
+
+class YaffsImporter::ListTask : public QRunnable {
+public:
+    ListTask(YaffsImporter& importer, YaffsImportEntry* dirEntry) : mImporter(importer), mDirEntry(dirEntry) {}
+
+    void run() {
+        if (!mImporter.isCancelled()) {
+            mImporter.listDirectory(mDirEntry);
+        }
+
+        mImporter.taskDone();
+    }
+
+private:
+    YaffsImporter& mImporter;
+    YaffsImportEntry* mDirEntry;
+};
+
+YaffsImporter::YaffsImporter(const QString& directoryName, QObject* parent) : QObject(parent) {
+    mRoot = new YaffsImportEntry(QFileInfo(directoryName).absoluteFilePath(), true, 0);
+    mTasksPending = 0;
+    mCancelled = 0;
+    mItemsFound = 0;
+    mPool.setMaxThreadCount(QThread::idealThreadCount());
+}
+
+YaffsImporter::~YaffsImporter() {
+    cancel();
+    wait();
+    delete mRoot;
+}
+
+void YaffsImporter::start() {
+    mItemsFound = 1;
+    queueDirectory(mRoot);
+}
+
+void YaffsImporter::wait() {
+    mPool.waitForDone();
+}
+
+void YaffsImporter::cancel() {
+    mCancelled = 1;
+}
+
+YaffsImportEntry* YaffsImporter::takeTree() {
+    YaffsImportEntry* tree = NULL;
+    if (!isCancelled()) {
+        tree = mRoot;
+        mRoot = NULL;
+    }
+    return tree;
+}
+
+void YaffsImporter::queueDirectory(YaffsImportEntry* dirEntry) {
+    mTasksPending.ref();
+    mPool.start(new ListTask(*this, dirEntry));
+}
+
+void YaffsImporter::taskDone() {
+    if (!mTasksPending.deref()) {
+        emit finished();
+    }
+}
+
+//only the task listing a directory touches its entry, the subdirectories found are filled in by tasks of their own
+void YaffsImporter::listDirectory(YaffsImportEntry* dirEntry) {
+#ifdef Q_OS_UNIX
+    //readdir() gets the entries in large batches and usually knows their type, so only files and links need a stat,
+    //which is done relative to the open directory rather than through the whole path
+    DIR* dir = opendir(QFile::encodeName(dirEntry->path).constData());
+    if (dir) {
+        int dirFd = dirfd(dir);
+        struct dirent* d;
+        while (!isCancelled() && (d = readdir(dir)) != NULL) {
+            if (strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0) {
+                continue;
+            }
+
+            QString entryPath = dirEntry->path + "/" + QFile::decodeName(d->d_name);
+            struct stat entryStat;
+#ifdef DT_DIR
+            if (d->d_type == DT_DIR) {
+                dirEntry->children.append(new YaffsImportEntry(entryPath, true, 0));
+                continue;
+            }
+#endif  //DT_DIR
+            //links to files are imported as the file, links to directories are left out so a link to an ancestor can't loop
+            if (fstatat(dirFd, d->d_name, &entryStat, AT_SYMLINK_NOFOLLOW) == 0) {
+                if (S_ISLNK(entryStat.st_mode) && (fstatat(dirFd, d->d_name, &entryStat, 0) != 0 || !S_ISREG(entryStat.st_mode))) {
+                    continue;
+                }
+                if (S_ISDIR(entryStat.st_mode)) {
+                    dirEntry->children.append(new YaffsImportEntry(entryPath, true, 0));
+                } else if (S_ISREG(entryStat.st_mode)) {
+                    dirEntry->children.append(new YaffsImportEntry(entryPath, false, entryStat.st_size));
+                }
+            }
+        }
+        closedir(dir);
+    }
+#else
+    QDirIterator dirs(dirEntry->path, QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System);
+    while (!isCancelled() && dirs.hasNext()) {
+        dirs.next();
+        QFileInfo fileInfo = dirs.fileInfo();
+        if (fileInfo.isDir()) {
+            if (fileInfo.isSymLink()) {
+                continue;
+            }
+            dirEntry->children.append(new YaffsImportEntry(fileInfo.absoluteFilePath(), true, 0));
+        } else if (fileInfo.isFile()) {
+            dirEntry->children.append(new YaffsImportEntry(fileInfo.absoluteFilePath(), false, fileInfo.size()));
+        }
+    }
+#endif  //Q_OS_UNIX
+
+    foreach (YaffsImportEntry* childEntry, dirEntry->children) {
+        if (childEntry->isDir) {
+            queueDirectory(childEntry);
+        }
+    }
+
+    int childCount = dirEntry->children.size();
+    int itemsFound = mItemsFound.fetchAndAddOrdered(childCount) + childCount;
+    if (itemsFound / PROGRESS_INTERVAL != (itemsFound - childCount) / PROGRESS_INTERVAL) {
+        emit progress(itemsFound);
+    }
+}
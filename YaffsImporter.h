@@ -0,0 +1,79 @@
+/*
+ * yaffey: Utility for reading, editing and writing YAFFS2 images
+ * Copyright (C) 2012 David Place <david.t.place@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef YAFFSIMPORTER_H
+#define YAFFSIMPORTER_H
+
+#include <QObject>
+#include <QString>
+#include <QList>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QtAlgorithms>
+
+//a file or directory found on the host by YaffsImporter
+struct YaffsImportEntry {
+    YaffsImportEntry(const QString& entryPath, bool entryIsDir, int entryFileSize) :
+        path(entryPath), isDir(entryIsDir), fileSize(entryFileSize) {}
+    ~YaffsImportEntry() { qDeleteAll(children); }
+
+    QString path;                           //absolute, the item name is the part after the last slash
+    bool isDir;
+    int fileSize;
+    QList<YaffsImportEntry*> children;      //owned, only filled in for directories
+};
+
+//Reads a host directory tree on a pool of threads without touching the model, so the tree can be added in one go.
+//Each directory is listed by one task, which queues another task for every subdirectory it finds. finished() is
+//emitted on the thread of the last task, once the whole tree has been read or the import has been cancelled.
+class YaffsImporter : public QObject {
+    Q_OBJECT
+
+public:
+    YaffsImporter(const QString& directoryName, QObject* parent = 0);
+    ~YaffsImporter();
+
+    void start();
+    void wait();
+    bool isCancelled() const { return (static_cast<int>(mCancelled) != 0); }
+    int getItemsFound() const { return mItemsFound; }
+    YaffsImportEntry* takeTree();           //the caller owns the tree, NULL if the import was cancelled
+
+public slots:
+    void cancel();
+
+signals:
+    void progress(int itemsFound);
+    void finished();
+
+private:
+    class ListTask;
+
+    void listDirectory(YaffsImportEntry* dirEntry);
+    void queueDirectory(YaffsImportEntry* dirEntry);
+    void taskDone();
+
+private:
+    YaffsImportEntry* mRoot;
+    QAtomicInt mTasksPending;
+    QAtomicInt mCancelled;
+    QAtomicInt mItemsFound;
+    QThreadPool mPool;                      //last, so it waits for the tasks before anything else is destroyed
+};
+
+#endif  //YAFFSIMPORTER_H
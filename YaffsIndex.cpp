@@ -0,0 +1,283 @@
+/*
+ * yaffey: Utility for reading, editing and writing YAFFS2 images
+ * Copyright (C) 2012 David Place <david.t.place@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDateTime>
+#include <QCryptographicHash>
+#include <QDesktopServices>
+
+#include "YaffsIndex.h"
+
+#define INDEX_MAGIC         "YAFFEYIX"
+#define INDEX_VERSION       5
+#define INDEX_SUFFIX        ".yidx"
+
+//number and size of the samples hashed to notice an image that changed without changing size or date
+#define KEY_SAMPLES         16
+#define KEY_SAMPLE_SIZE     4096
+
+struct IndexFileHeader {
+    char magic[8];
+    u32 version;
+    u32 headerSize;
+    u32 entrySize;
+    u32 numEntries;
+    u32 stringsSize;
+    u32 chunkMapSize;
+    qint64 imageSize;
+    qint64 imageModified;
+    char imageSampleHash[20];
+    u32 oobLayout;
+    YaffsReadInfo readInfo;
+};
+
+YaffsIndex::YaffsIndex(const QString& imageFilename, int oobLayout, YaffsControlObserver* observer) {
+    mImageFilename = imageFilename;
+    mOobLayout = oobLayout;
+    mObserver = observer;
+    mImageSize = 0;
+    mImageModified = 0;
+}
+
+bool YaffsIndex::load(YaffsReadInfo& readInfo, YaffsChunkMap& chunkMap) {
+    if (!readImageKey()) {
+        return false;
+    }
+
+    QString indexFilename = getIndexFilename();
+    QFile indexFile(indexFilename);
+    if (indexFilename.isEmpty() || !indexFile.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    qint64 size = indexFile.size();
+    if (size < static_cast<qint64>(sizeof(IndexFileHeader))) {
+        return false;
+    }
+
+    uchar* data = indexFile.map(0, size);
+    if (data == NULL) {
+        return false;
+    }
+
+    const IndexFileHeader* header = reinterpret_cast<const IndexFileHeader*>(data);
+    const Entry* entries = reinterpret_cast<const Entry*>(data + sizeof(IndexFileHeader));
+    const char* strings = reinterpret_cast<const char*>(entries + header->numEntries);
+
+    bool valid = (memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) == 0 &&
+                  header->version == INDEX_VERSION &&
+                  header->headerSize == sizeof(IndexFileHeader) &&
+                  header->entrySize == sizeof(Entry) &&
+                  header->imageSize == mImageSize &&
+                  header->imageModified == mImageModified &&
+                  memcmp(header->imageSampleHash, mImageSampleHash.constData(), sizeof(header->imageSampleHash)) == 0 &&
+                  header->oobLayout == static_cast<u32>(mOobLayout) &&
+                  size == static_cast<qint64>(sizeof(IndexFileHeader) + header->numEntries * sizeof(Entry) +
+                                              header->stringsSize + header->chunkMapSize));
+
+    //check every entry before handing anything to the observer
+    for (u32 i = 0; valid && i < header->numEntries; ++i) {
+        const Entry& entry = entries[i];
+        valid = (entry.nameLength <= YAFFS_MAX_NAME_LENGTH &&
+                 entry.aliasLength <= YAFFS_MAX_ALIAS_LENGTH &&
+                 entry.stringOffset + entry.nameLength + entry.aliasLength <= header->stringsSize);
+    }
+
+    if (valid) {
+        QByteArray chunkMapData = QByteArray::fromRawData(strings + header->stringsSize, header->chunkMapSize);
+        valid = chunkMap.fromByteArray(chunkMapData);
+    }
+
+    if (valid) {
+        yaffs_obj_hdr objectHeader;
+        for (u32 i = 0; i < header->numEntries; ++i) {
+            const Entry& entry = entries[i];
+            headerFromEntry(entry, strings, objectHeader);
+            mObserver->newItem(entry.objectId, &objectHeader, entry.headerPos, entry.headerLoaded != 0);
+        }
+        mObserver->readComplete();
+        readInfo = header->readInfo;
+    }
+
+    indexFile.unmap(data);
+    return valid;
+}
+
+bool YaffsIndex::save(const YaffsReadInfo& readInfo, const YaffsChunkMap& chunkMap) {
+    if (mImageSampleHash.isEmpty() && !readImageKey()) {
+        return false;
+    }
+
+    IndexFileHeader header;
+    memset(&header, 0, sizeof(IndexFileHeader));
+    memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    header.version = INDEX_VERSION;
+    header.headerSize = sizeof(IndexFileHeader);
+    header.entrySize = sizeof(Entry);
+    header.numEntries = mEntries.size();
+    header.stringsSize = mStrings.size();
+    QByteArray chunkMapData = chunkMap.toByteArray();
+    header.chunkMapSize = chunkMapData.size();
+    header.imageSize = mImageSize;
+    header.imageModified = mImageModified;
+    memcpy(header.imageSampleHash, mImageSampleHash.constData(), sizeof(header.imageSampleHash));
+    header.oobLayout = mOobLayout;
+    header.readInfo = readInfo;
+
+    QString indexFilename = getIndexFilename();
+    if (indexFilename.isEmpty()) {
+        return false;
+    }
+
+    //indexes of earlier versions of the image will never match again
+    QDir indexDir = QFileInfo(indexFilename).absoluteDir();
+    indexDir.mkpath(".");
+    foreach (const QString& oldFilename, indexDir.entryList(QStringList(getPathKey() + "-*" + INDEX_SUFFIX), QDir::Files)) {
+        indexDir.remove(oldFilename);
+    }
+
+    QFile indexFile(indexFilename);
+    if (!indexFile.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    bool result = (indexFile.write(reinterpret_cast<const char*>(&header), sizeof(IndexFileHeader)) != -1 &&
+                   indexFile.write(reinterpret_cast<const char*>(mEntries.constData()), mEntries.size() * sizeof(Entry)) != -1 &&
+                   indexFile.write(mStrings) != -1 &&
+                   indexFile.write(chunkMapData) != -1);
+    indexFile.close();
+    if (!result) {
+        indexFile.remove();
+    }
+    return result;
+}
+
+void YaffsIndex::newItem(int yaffsObjectId, const yaffs_obj_hdr* objectHeader, int fileOffset, bool headerLoaded) {
+    Entry entry;
+    memset(&entry, 0, sizeof(Entry));
+    entry.objectId = yaffsObjectId;
+    entry.headerPos = fileOffset;
+    entry.headerLoaded = headerLoaded;
+    entry.type = objectHeader->type;
+    entry.parentId = objectHeader->parent_obj_id;
+    entry.mode = objectHeader->yst_mode;
+    entry.uid = objectHeader->yst_uid;
+    entry.gid = objectHeader->yst_gid;
+    entry.atime = objectHeader->yst_atime;
+    entry.mtime = objectHeader->yst_mtime;
+    entry.ctime = objectHeader->yst_ctime;
+    entry.fileSizeLow = objectHeader->file_size_low;
+    entry.fileSizeHigh = objectHeader->file_size_high;
+    entry.equivId = objectHeader->equiv_id;
+    entry.rdev = objectHeader->yst_rdev;
+    memcpy(&entry.winTimes[0], objectHeader->win_ctime, sizeof(objectHeader->win_ctime));
+    memcpy(&entry.winTimes[2], objectHeader->win_atime, sizeof(objectHeader->win_atime));
+    memcpy(&entry.winTimes[4], objectHeader->win_mtime, sizeof(objectHeader->win_mtime));
+    entry.inbandShadowedObjectId = objectHeader->inband_shadowed_obj_id;
+    entry.inbandIsShrink = objectHeader->inband_is_shrink;
+    entry.reserved = objectHeader->reserved[0];
+    entry.shadowsObject = objectHeader->shadows_obj;
+    entry.isShrink = objectHeader->is_shrink;
+    entry.checksum = objectHeader->sum_no_longer_used;
+    entry.nameLength = qstrnlen(objectHeader->name, YAFFS_MAX_NAME_LENGTH);
+    entry.aliasLength = qstrnlen(objectHeader->alias, YAFFS_MAX_ALIAS_LENGTH);
+    entry.nameTail = objectHeader->name[YAFFS_MAX_NAME_LENGTH];
+    entry.aliasTail = objectHeader->alias[YAFFS_MAX_ALIAS_LENGTH];
+    entry.stringOffset = mStrings.size();
+    mStrings.append(objectHeader->name, entry.nameLength);
+    mStrings.append(objectHeader->alias, entry.aliasLength);
+    mEntries.append(entry);
+
+    mObserver->newItem(yaffsObjectId, objectHeader, fileOffset, headerLoaded);
+}
+
+void YaffsIndex::readComplete() {
+    mObserver->readComplete();
+}
+
+//the same for every version of one image
+QString YaffsIndex::getPathKey() const {
+    QByteArray pathHash = QCryptographicHash::hash(QFileInfo(mImageFilename).absoluteFilePath().toUtf8(), QCryptographicHash::Sha1);
+    return QString(pathHash.toHex());
+}
+
+//indexes live in the cache directory, named after the path, size and modification time of the image, so an image
+//that was saved since is simply not found. the sample hash checked in load() catches changes that keep all three.
+QString YaffsIndex::getIndexFilename() const {
+    QString cacheDir = QDesktopServices::storageLocation(QDesktopServices::CacheLocation);
+    if (cacheDir.isEmpty()) {
+        return QString();
+    }
+    return cacheDir + "/index/" + getPathKey() + QString("-%1-%2").arg(mImageSize).arg(mImageModified) + INDEX_SUFFIX;
+}
+
+bool YaffsIndex::readImageKey() {
+    QFileInfo imageInfo(mImageFilename);
+    QFile imageFile(mImageFilename);
+    if (!imageFile.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    mImageSize = imageInfo.size();
+    mImageModified = imageInfo.lastModified().toMSecsSinceEpoch();
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    qint64 lastSample = qMax<qint64>(mImageSize - KEY_SAMPLE_SIZE, 0);
+    for (int i = 0; i < KEY_SAMPLES; ++i) {
+        if (imageFile.seek(lastSample * i / (KEY_SAMPLES - 1))) {
+            hash.addData(imageFile.read(KEY_SAMPLE_SIZE));
+        }
+    }
+    mImageSampleHash = hash.result();
+
+    return true;
+}
+
+void YaffsIndex::headerFromEntry(const Entry& entry, const char* strings, yaffs_obj_hdr& objectHeader) const {
+    memset(&objectHeader, 0xff, sizeof(yaffs_obj_hdr));
+    memset(objectHeader.name, 0, YAFFS_MAX_NAME_LENGTH);
+    memset(objectHeader.alias, 0, YAFFS_MAX_ALIAS_LENGTH);
+    memcpy(objectHeader.name, strings + entry.stringOffset, entry.nameLength);
+    memcpy(objectHeader.alias, strings + entry.stringOffset + entry.nameLength, entry.aliasLength);
+    objectHeader.name[YAFFS_MAX_NAME_LENGTH] = entry.nameTail;
+    objectHeader.alias[YAFFS_MAX_ALIAS_LENGTH] = entry.aliasTail;
+
+    objectHeader.type = static_cast<yaffs_obj_type>(entry.type);
+    objectHeader.parent_obj_id = entry.parentId;
+    objectHeader.sum_no_longer_used = entry.checksum;
+    objectHeader.yst_mode = entry.mode;
+    objectHeader.yst_uid = entry.uid;
+    objectHeader.yst_gid = entry.gid;
+    objectHeader.yst_atime = entry.atime;
+    objectHeader.yst_mtime = entry.mtime;
+    objectHeader.yst_ctime = entry.ctime;
+    objectHeader.file_size_low = entry.fileSizeLow;
+    objectHeader.equiv_id = entry.equivId;
+    objectHeader.yst_rdev = entry.rdev;
+    memcpy(objectHeader.win_ctime, &entry.winTimes[0], sizeof(objectHeader.win_ctime));
+    memcpy(objectHeader.win_atime, &entry.winTimes[2], sizeof(objectHeader.win_atime));
+    memcpy(objectHeader.win_mtime, &entry.winTimes[4], sizeof(objectHeader.win_mtime));
+    objectHeader.inband_shadowed_obj_id = entry.inbandShadowedObjectId;
+    objectHeader.inband_is_shrink = entry.inbandIsShrink;
+    objectHeader.file_size_high = entry.fileSizeHigh;
+    objectHeader.reserved[0] = entry.reserved;
+    objectHeader.shadows_obj = entry.shadowsObject;
+    objectHeader.is_shrink = entry.isShrink;
+}
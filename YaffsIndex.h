@@ -0,0 +1,88 @@
+/*
+ * yaffey: Utility for reading, editing and writing YAFFS2 images
+ * Copyright (C) 2012 David Place <david.t.place@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef YAFFSINDEX_H
+#define YAFFSINDEX_H
+
+#include <QStringList>
+#include <QVector>
+#include <QByteArray>
+
+#include "YaffsControl.h"
+
+//Caches the result of scanning an image in the cache directory so it can be reopened without a scan.
+//While scanning it sits between YaffsControl and the real observer and records every object.
+class YaffsIndex : public YaffsControlObserver {
+public:
+    YaffsIndex(const QString& imageFilename, int oobLayout, YaffsControlObserver* observer);
+
+    bool load(YaffsReadInfo& readInfo, YaffsChunkMap& chunkMap);
+    bool save(const YaffsReadInfo& readInfo, const YaffsChunkMap& chunkMap);
+
+    //from YaffsControlObserver
+    void newItem(int yaffsObjectId, const yaffs_obj_hdr* objectHeader, int fileOffset, bool headerLoaded);
+    void readComplete();
+
+private:
+    struct Entry {
+        qint32 objectId;
+        qint32 headerPos;
+        u32 headerLoaded;
+        u32 type;
+        qint32 parentId;
+        u32 mode;
+        u32 uid;
+        u32 gid;
+        u32 atime;
+        u32 mtime;
+        u32 ctime;
+        u32 fileSizeLow;
+        u32 fileSizeHigh;
+        qint32 equivId;
+        u32 rdev;
+        u32 winTimes[6];
+        u32 inbandShadowedObjectId;
+        u32 inbandIsShrink;
+        u32 reserved;
+        qint32 shadowsObject;
+        u32 isShrink;
+        u16 checksum;
+        u16 nameLength;
+        u16 aliasLength;
+        u8 nameTail;        //last byte of the name and alias buffers, to rebuild headers exactly
+        u8 aliasTail;
+        u32 stringOffset;   //name followed by alias in the string table
+    };
+
+    QString getPathKey() const;
+    QString getIndexFilename() const;
+    bool readImageKey();
+    void headerFromEntry(const Entry& entry, const char* strings, yaffs_obj_hdr& objectHeader) const;
+
+private:
+    QString mImageFilename;
+    int mOobLayout;
+    YaffsControlObserver* mObserver;
+    qint64 mImageSize;
+    qint64 mImageModified;
+    QByteArray mImageSampleHash;
+    QVector<Entry> mEntries;
+    QByteArray mStrings;
+};
+
+#endif  //YAFFSINDEX_H
@@ -25,46 +25,50 @@
 #include "YaffsItem.h"
 #include "AndroidIDs.h"
 
-YaffsItem::YaffsItem(YaffsItem* parent, const yaffs_obj_hdr* yaffsObjectHeader, int headerPosition, int yaffsObjectId) {
+YaffsItem::YaffsItem(YaffsItem* parent, YaffsObjectTable* objectTable, int objectRow) {
     mParentItem = parent;
-    if (yaffsObjectHeader != NULL) {
-        memcpy(&mYaffsObjectHeader, yaffsObjectHeader, sizeof(yaffs_obj_hdr));
-    }
-    mHeaderPosition = headerPosition;
-    mYaffsObjectId = yaffsObjectId;
+    mObjectTable = objectTable;
+    mObjectRow = objectRow;
     mCondition = CLEAN;
     mMarkedForDelete = false;
     mHasChildMarkedForDelete = false;
+    mHasChildWithoutHeader = false;
 }
 
-YaffsItem::YaffsItem(YaffsItem* parent, const QString& name, yaffs_obj_type type) {
+YaffsItem::YaffsItem(YaffsItem* parent, YaffsObjectTable* objectTable, const QString& name, yaffs_obj_type type) {
     mParentItem = parent;
-
-    memset(&mYaffsObjectHeader, 0xff, sizeof(yaffs_obj_hdr));
-    setName(name);
-    mYaffsObjectHeader.type = type;
-    mYaffsObjectHeader.yst_ctime = QDateTime::currentDateTime().toTime_t();
-    mYaffsObjectHeader.yst_atime = mYaffsObjectHeader.yst_ctime;
-    mYaffsObjectHeader.yst_mtime = mYaffsObjectHeader.yst_ctime;
-
-    mHeaderPosition = -1;
-    mYaffsObjectId = -1;
+    mObjectTable = objectTable;
+
+    yaffs_obj_hdr header;
+    memset(&header, 0xff, sizeof(yaffs_obj_hdr));
+    memset(header.name, 0, YAFFS_MAX_NAME_LENGTH);
+    memset(header.alias, 0, YAFFS_MAX_ALIAS_LENGTH);
+    header.type = type;
+    header.yst_ctime = QDateTime::currentDateTime().toTime_t();
+    header.yst_atime = header.yst_ctime;
+    header.yst_mtime = header.yst_ctime;
+    mObjectRow = mObjectTable->append(-1, -1, header, true);
 
     mCondition = NEW;
+    mMarkedForDelete = false;
+    mHasChildMarkedForDelete = false;
+    mHasChildWithoutHeader = false;
+
+    setName(name);
 }
 
 YaffsItem::~YaffsItem() {
     qDeleteAll(mChildItems);
 }
 
-YaffsItem* YaffsItem::createRoot() {
-    YaffsItem* item = new YaffsItem(NULL, "", YAFFS_OBJECT_TYPE_DIRECTORY);
+YaffsItem* YaffsItem::createRoot(YaffsObjectTable* objectTable) {
+    YaffsItem* item = new YaffsItem(NULL, objectTable, "", YAFFS_OBJECT_TYPE_DIRECTORY);
 
-    item->mYaffsObjectId = YAFFS_OBJECTID_ROOT;
-    item->mYaffsObjectHeader.parent_obj_id = item->mYaffsObjectId;
-    item->mYaffsObjectHeader.yst_mode = 0771 | 0x4000;
-    item->mYaffsObjectHeader.yst_uid = 0;
-    item->mYaffsObjectHeader.yst_gid = 0;
+    item->setObjectId(YAFFS_OBJECTID_ROOT);
+    item->setParentObjectId(YAFFS_OBJECTID_ROOT);
+    objectTable->setMode(item->mObjectRow, 0771 | 0x4000);
+    objectTable->setUserId(item->mObjectRow, 0);
+    objectTable->setGroupId(item->mObjectRow, 0);
 
     return item;
 }
@@ -73,14 +77,14 @@ YaffsItem* YaffsItem::createFile(YaffsItem* parentItem, const QString& filenameW
     int slashPos = filenameWithPath.lastIndexOf('/');
     QString filename = filenameWithPath.mid(slashPos + 1);
 
-    YaffsItem* item = new YaffsItem(parentItem, filename, YAFFS_OBJECT_TYPE_FILE);
-    const yaffs_obj_hdr& parentHeader = parentItem->getHeader();
+    YaffsObjectTable* objectTable = parentItem->mObjectTable;
+    YaffsItem* item = new YaffsItem(parentItem, objectTable, filename, YAFFS_OBJECT_TYPE_FILE);
     item->mExternalFilename = filenameWithPath;
-    item->mYaffsObjectHeader.parent_obj_id = parentItem->mYaffsObjectId;
-    item->mYaffsObjectHeader.yst_mode = parentHeader.yst_mode;
-    item->mYaffsObjectHeader.yst_uid = parentHeader.yst_uid;
-    item->mYaffsObjectHeader.yst_gid = parentHeader.yst_gid;
-    item->mYaffsObjectHeader.file_size_low = filesize;
+    item->setParentObjectId(parentItem->getObjectId());
+    objectTable->setMode(item->mObjectRow, parentItem->getPermissions());
+    objectTable->setUserId(item->mObjectRow, parentItem->getUserId());
+    objectTable->setGroupId(item->mObjectRow, parentItem->getGroupId());
+    objectTable->setFileSize(item->mObjectRow, filesize);
 
     return item;
 }
@@ -89,16 +93,22 @@ YaffsItem* YaffsItem::createDirectory(YaffsItem* parentItem, const QString& dirN
     int slashPos = dirNameWithPath.lastIndexOf('/');
     QString dirName = dirNameWithPath.mid(slashPos + 1);
 
-    YaffsItem* item = new YaffsItem(parentItem, dirName, YAFFS_OBJECT_TYPE_DIRECTORY);
-    const yaffs_obj_hdr& parentHeader = parentItem->getHeader();
-    item->mYaffsObjectHeader.parent_obj_id = parentItem->mYaffsObjectId;
-    item->mYaffsObjectHeader.yst_mode = parentHeader.yst_mode;
-    item->mYaffsObjectHeader.yst_uid = parentHeader.yst_uid;
-    item->mYaffsObjectHeader.yst_gid = parentHeader.yst_gid;
+    YaffsObjectTable* objectTable = parentItem->mObjectTable;
+    YaffsItem* item = new YaffsItem(parentItem, objectTable, dirName, YAFFS_OBJECT_TYPE_DIRECTORY);
+    item->setParentObjectId(parentItem->getObjectId());
+    objectTable->setMode(item->mObjectRow, parentItem->getPermissions());
+    objectTable->setUserId(item->mObjectRow, parentItem->getUserId());
+    objectTable->setGroupId(item->mObjectRow, parentItem->getGroupId());
 
     return item;
 }
 
+yaffs_obj_hdr YaffsItem::getHeader() const {
+    yaffs_obj_hdr header;
+    mObjectTable->getHeader(mObjectRow, header);
+    return header;
+}
+
 void YaffsItem::removeChild(int row) {
     YaffsItem* item = mChildItems.at(row);
     delete item;
@@ -107,9 +117,9 @@ void YaffsItem::removeChild(int row) {
 
 QVariant YaffsItem::data(int column) const {
     if (column == NAME) {
-        return mYaffsObjectHeader.name;
+        return getName();
     } else if (column == SIZE) {
-        int fileSize = mYaffsObjectHeader.file_size_low;
+        int fileSize = getFileSize();
         if (fileSize != -1) {
             if (fileSize >= 1048576) {
                 return QString::number(fileSize / 1048576.0f, 'f', 2) + " MB";
@@ -120,33 +130,33 @@ QVariant YaffsItem::data(int column) const {
             }
         }
     } else if (column == PERMISSIONS) {
-        return parseMode(mYaffsObjectHeader.yst_mode);
+        return parseMode(getPermissions());
     } else if (column == ALIAS) {
         if (isSymLink()) {
-            return mYaffsObjectHeader.alias;
+            return getAlias();
         }
     } else if (column == DATE_ACCESSED) {
-        QDateTime atime = QDateTime::fromTime_t(mYaffsObjectHeader.yst_atime);
+        QDateTime atime = QDateTime::fromTime_t(mObjectTable->getAccessTime(mObjectRow));
         return atime.toString("dd/MM/yyyy hh:mm:ss");
     } else if (column == DATE_CREATED) {
-        QDateTime ctime = QDateTime::fromTime_t(mYaffsObjectHeader.yst_ctime);
+        QDateTime ctime = QDateTime::fromTime_t(mObjectTable->getChangeTime(mObjectRow));
         return ctime.toString("dd/MM/yyyy hh:mm:ss");
     } else if (column == DATE_MODIFIED) {
-        QDateTime mtime = QDateTime::fromTime_t(mYaffsObjectHeader.yst_mtime);
+        QDateTime mtime = QDateTime::fromTime_t(mObjectTable->getModifyTime(mObjectRow));
         return mtime.toString("dd/MM/yyyy hh:mm:ss");
     } else if (column == USER) {
-        QString uid = ANDROID_IDS.value(mYaffsObjectHeader.yst_uid);
+        QString uid = ANDROID_IDS.value(getUserId());
         if (uid.length() > 0) {
             return uid;
         } else {
-            return mYaffsObjectHeader.yst_uid;
+            return getUserId();
         }
     } else if (column == GROUP) {
-        QString gid = ANDROID_IDS.value(mYaffsObjectHeader.yst_gid);
+        QString gid = ANDROID_IDS.value(getGroupId());
         if (gid.length() > 0) {
             return gid;
         } else {
-            return mYaffsObjectHeader.yst_gid;
+            return getGroupId();
         }
     }
 #ifdef QT_DEBUG
@@ -159,7 +169,7 @@ QVariant YaffsItem::data(int column) const {
             return "";
         }
     } else if (column == HEADERPOS) {
-        return mHeaderPosition;
+        return getHeaderPosition();
     }
 #endif  //QT_DEBUG
     return QVariant();
@@ -195,21 +205,18 @@ void YaffsItem::setName(const QString& name) {
         if (newName.length() > YAFFS_MAX_NAME_LENGTH) {
             newName.truncate(YAFFS_MAX_NAME_LENGTH);
         }
-        size_t len = static_cast<size_t>(newName.length());
-        QString currentName(mYaffsObjectHeader.name);
-        if (newName != currentName) {
-            memset(mYaffsObjectHeader.name, 0, YAFFS_MAX_NAME_LENGTH);
-            memcpy(mYaffsObjectHeader.name, newName.toStdString().c_str(), len);
+        if (newName != getName()) {
+            mObjectTable->setName(mObjectRow, newName.toStdString().c_str());
             makeDirty();
         }
     } else {
-        memset(mYaffsObjectHeader.name, 0, YAFFS_MAX_NAME_LENGTH);
+        mObjectTable->setName(mObjectRow, "");
     }
 }
 
 void YaffsItem::setPermissions(uint permissions) {
-    if (permissions != mYaffsObjectHeader.yst_mode) {
-        mYaffsObjectHeader.yst_mode = permissions;
+    if (permissions != getPermissions()) {
+        mObjectTable->setMode(mObjectRow, permissions);
         makeDirty();
     }
 }
@@ -221,10 +228,8 @@ void YaffsItem::setAlias(const QString& alias) {
             if (newAlias.length() > YAFFS_MAX_ALIAS_LENGTH) {
                 newAlias.truncate(YAFFS_MAX_ALIAS_LENGTH);
             }
-            QString currentAlias(mYaffsObjectHeader.alias);
-            if (newAlias != currentAlias) {
-                memset(mYaffsObjectHeader.alias, 0, YAFFS_MAX_ALIAS_LENGTH);
-                strcpy(mYaffsObjectHeader.alias, newAlias.toStdString().c_str());
+            if (newAlias != getAlias()) {
+                mObjectTable->setAlias(mObjectRow, newAlias.toStdString().c_str());
                 makeDirty();
             }
         }
@@ -232,15 +237,15 @@ void YaffsItem::setAlias(const QString& alias) {
 }
 
 void YaffsItem::setUserId(uint uid) {
-    if (uid != mYaffsObjectHeader.yst_uid) {
-        mYaffsObjectHeader.yst_uid = uid;
+    if (uid != getUserId()) {
+        mObjectTable->setUserId(mObjectRow, uid);
         makeDirty();
     }
 }
 
 void YaffsItem::setGroupId(uint gid) {
-    if (gid != mYaffsObjectHeader.yst_gid) {
-        mYaffsObjectHeader.yst_gid = gid;
+    if (gid != getGroupId()) {
+        mObjectTable->setGroupId(mObjectRow, gid);
         makeDirty();
     }
 }
@@ -268,7 +273,7 @@ void YaffsItem::makeDirty() {
 QString YaffsItem::parseMode(int mode) const {
     char dest[11];
 
-    switch (mYaffsObjectHeader.type) {
+    switch (mObjectTable->getType(mObjectRow)) {
     case YAFFS_OBJECT_TYPE_FILE:
     case YAFFS_OBJECT_TYPE_HARDLINK:
         dest[0] = '-';
@@ -23,7 +23,7 @@
 #include <QVariant>
 #include <QModelIndex>
 
-#include "Yaffs2.h"
+#include "YaffsObjectTable.h"
 
 //linux permissions
 #define SPECIAL_SETUID  0x800
@@ -39,9 +39,10 @@
 #define ALL_WRITE       0x2
 #define ALL_EXECUTE     0x1
 
+//A node of the tree shown by the view. The object itself lives in a row of a YaffsObjectTable.
 class YaffsItem {
 public:
-    YaffsItem(YaffsItem* parent, const yaffs_obj_hdr* yaffsObjectHeader, int headerPosition, int yaffsObjectId);
+    YaffsItem(YaffsItem* parent, YaffsObjectTable* objectTable, int objectRow);
     ~YaffsItem();
 
     enum Condition {
@@ -69,7 +70,7 @@ public:
         COLUMN_COUNT
     };
 
-    static YaffsItem* createRoot();
+    static YaffsItem* createRoot(YaffsObjectTable* objectTable);
     static YaffsItem* createFile(YaffsItem* parentItem, const QString& filenameWithPath, int filesize);
     static YaffsItem* createDirectory(YaffsItem* parentItem, const QString& filenameWithPath);
 
@@ -82,13 +83,18 @@ public:
     void setUserId(uint uid);
     void setGroupId(uint gid);
     void setCondition(Condition condition) { mCondition = condition; }
-    void setObjectId(int objectId) { mYaffsObjectId = objectId; }
-    void setParentObjectId(int parentObjectId) { mYaffsObjectHeader.parent_obj_id = parentObjectId; }
-    void setHeaderPosition(int headerPos) { mHeaderPosition = headerPos; }
+    void setObjectId(int objectId) { mObjectTable->setObjectId(mObjectRow, objectId); }
+    void setParentObjectId(int parentObjectId) { mObjectTable->setParentObjectId(mObjectRow, parentObjectId); }
+    void setHeaderPosition(int headerPos) { mObjectTable->setHeaderPosition(mObjectRow, headerPos); }
+    void setHeader(const yaffs_obj_hdr& yaffsObjectHeader) { mObjectTable->setHeader(mObjectRow, yaffsObjectHeader); }
+    void setHeaderLoaded(bool loaded) { mObjectTable->setHeaderLoaded(mObjectRow, loaded); }
+    void setHasChildWithoutHeader(bool without) { mHasChildWithoutHeader = without; }
     void markForDelete();
     void setHasChildMarkedForDelete(bool mark) { mHasChildMarkedForDelete = mark; }
     bool isMarkedForDelete() { return mMarkedForDelete; }
     bool hasChildMarkedForDelete() { return mHasChildMarkedForDelete; }
+    bool isHeaderLoaded() const { return mObjectTable->isHeaderLoaded(mObjectRow); }
+    bool hasChildWithoutHeader() const { return mHasChildWithoutHeader; }
 
     void appendChild(YaffsItem* child) { mChildItems.append(child); }
     void removeChild(int row);
@@ -98,37 +104,39 @@ public:
     const YaffsItem* parent() const { return mParentItem; }
     YaffsItem* child(int row) { return mChildItems.value(row); }
     const YaffsItem* child(int row) const { return mChildItems.value(row); }
-    QString getName() const { return mYaffsObjectHeader.name; }
+    QString getName() const { return mObjectTable->getName(mObjectRow); }
     QString getExternalFilename() const { return mExternalFilename; }
-    QString getAlias() const { return mYaffsObjectHeader.alias; }
-    int getHeaderPosition() const { return mHeaderPosition; }
-    const yaffs_obj_hdr& getHeader() const { return mYaffsObjectHeader; }
-    int getFileSize() const { return mYaffsObjectHeader.file_size_low; }
-    uint getUserId() const { return mYaffsObjectHeader.yst_uid; }
-    uint getGroupId() const { return mYaffsObjectHeader.yst_gid; }
-    uint getPermissions() const { return mYaffsObjectHeader.yst_mode; }
-    int getObjectId() const { return mYaffsObjectId; }
+    QString getAlias() const { return mObjectTable->getAlias(mObjectRow); }
+    int getHeaderPosition() const { return mObjectTable->getHeaderPosition(mObjectRow); }
+    yaffs_obj_hdr getHeader() const;
+    int getObjectRow() const { return mObjectRow; }
+    int getFileSize() const { return mObjectTable->getFileSize(mObjectRow); }
+    uint getUserId() const { return mObjectTable->getUserId(mObjectRow); }
+    uint getGroupId() const { return mObjectTable->getGroupId(mObjectRow); }
+    uint getPermissions() const { return mObjectTable->getMode(mObjectRow); }
+    int getObjectId() const { return mObjectTable->getObjectId(mObjectRow); }
     bool isRoot() const { return (mParentItem == NULL); }
-    bool isDir() const { return mYaffsObjectHeader.type == YAFFS_OBJECT_TYPE_DIRECTORY; }
-    bool isFile() const { return mYaffsObjectHeader.type == YAFFS_OBJECT_TYPE_FILE; }
-    bool isSymLink() const { return mYaffsObjectHeader.type == YAFFS_OBJECT_TYPE_SYMLINK; }
+    bool isDir() const { return mObjectTable->getType(mObjectRow) == YAFFS_OBJECT_TYPE_DIRECTORY; }
+    bool isFile() const { return mObjectTable->getType(mObjectRow) == YAFFS_OBJECT_TYPE_FILE; }
+    bool isSymLink() const { return mObjectTable->getType(mObjectRow) == YAFFS_OBJECT_TYPE_SYMLINK; }
+    bool isHardLink() const { return mObjectTable->getType(mObjectRow) == YAFFS_OBJECT_TYPE_HARDLINK; }
     Condition getCondition() const { return mCondition; }
 
 private:
-    YaffsItem(YaffsItem* parent, const QString& name, yaffs_obj_type type);
+    YaffsItem(YaffsItem* parent, YaffsObjectTable* objectTable, const QString& name, yaffs_obj_type type);
     QString parseMode(int mode) const;
     void makeDirty();
 
 private:
     YaffsItem* mParentItem;
-    int mHeaderPosition;
-    int mYaffsObjectId;
+    YaffsObjectTable* mObjectTable;     //not owned
+    int mObjectRow;
     QList<YaffsItem*> mChildItems;
-    yaffs_obj_hdr mYaffsObjectHeader;
     Condition mCondition;
     QString mExternalFilename;      //filename with path - only for new files
     bool mMarkedForDelete;
     bool mHasChildMarkedForDelete;
+    bool mHasChildWithoutHeader;
 };
 
 #endif  //YAFFSITEM_H
@@ -17,9 +17,170 @@
  */
 
 #include <QDir>
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QMutex>
+#include <QAtomicInt>
 
 #include "YaffsManager.h"
 #include "YaffsControl.h"
+#include "YaffsFileDevice.h"
+
+//files are streamed through one buffer per worker, a whole number of chunks
+#define EXPORT_BUFFER_SIZE      (128 * CHUNK_SIZE)
+
+//large files are split into parts of this size, exported by separate tasks so one file uses every worker
+#define EXPORT_PART_SIZE        (8 * EXPORT_BUFFER_SIZE)
+
+namespace {
+    //what the tasks exporting the parts of one file share, the last one to finish reports the file
+    struct ExportFileState {
+        ExportFileState(const YaffsItem* exportItem, const QString& exportFilename, const YaffsFile& file, int numParts) :
+            item(exportItem), filename(exportFilename), yaffsFile(file), partsLeft(numParts), result(true) {
+        }
+
+        const YaffsItem* item;
+        QString filename;
+        YaffsFile yaffsFile;
+        QAtomicInt partsLeft;
+        QMutex mutex;                   //for result and eccInfo
+        bool result;
+        YaffsEccInfo eccInfo;
+    };
+
+    //copies one part of a file out of the image into the already created file, through one buffer. the data ECC of
+    //the part's chunks is checked when verifyDataEcc is set, chunks the ECC can't correct are reported with the file.
+    class ExportPartTask : public QRunnable {
+    public:
+        ExportPartTask(const YaffsControl& control, ExportFileState* state, long partOffset, bool verify,
+                       YaffsExportInfo& info, QMutex& mutex) :
+            yaffsControl(control), fileState(state), offset(partOffset), verifyDataEcc(verify),
+            exportInfo(info), exportInfoMutex(mutex) {
+        }
+
+        const YaffsControl& yaffsControl;
+        ExportFileState* fileState;
+        long offset;
+        bool verifyDataEcc;
+        YaffsExportInfo& exportInfo;
+        QMutex& exportInfoMutex;
+
+        void run() {
+            YaffsEccInfo eccInfo;
+            bool result = exportPart(verifyDataEcc ? &eccInfo : NULL);
+
+            {
+                QMutexLocker locker(&fileState->mutex);
+                fileState->result = (fileState->result && result);
+                fileState->eccInfo.numCorrected += eccInfo.numCorrected;
+                fileState->eccInfo.numUncorrectable += eccInfo.numUncorrectable;
+                fileState->eccInfo.uncorrectableChunks += eccInfo.uncorrectableChunks;
+            }
+
+            if (!fileState->partsLeft.deref()) {
+                finishFile();
+            }
+        }
+
+    private:
+        bool exportPart(YaffsEccInfo* eccInfo) {
+            const YaffsFile& yaffsFile = fileState->yaffsFile;
+            long end = qMin<long>(offset + EXPORT_PART_SIZE, yaffsFile.size);
+            if (offset >= end) {
+                return true;
+            }
+
+            YaffsFileDevice device(yaffsControl, yaffsFile, eccInfo);
+            QFile file(fileState->filename);
+            if (!device.open(QIODevice::ReadOnly) || !device.seek(offset) || !file.open(QIODevice::ReadWrite) || !file.seek(offset)) {
+                return false;
+            }
+
+            QByteArray buffer(qMin<long>(EXPORT_BUFFER_SIZE, end - offset), 0);
+            for (long position = offset; position < end; ) {
+                long length = qMin<long>(buffer.size(), end - position);
+                if (device.read(buffer.data(), length) != length || file.write(buffer.constData(), length) != length) {
+                    return false;
+                }
+                position += length;
+            }
+            return true;
+        }
+
+        void finishFile() {
+            if (!fileState->result) {
+                QFile::remove(fileState->filename);
+            }
+
+            QMutexLocker locker(&exportInfoMutex);
+            const YaffsItem* item = fileState->item;
+            if (fileState->result) {
+                exportInfo.numFilesExported++;
+                if (fileState->eccInfo.numUncorrectable > 0) {
+                    QList<u32>& chunks = exportInfo.fileEccUncorrectableChunks[item];
+                    chunks = fileState->eccInfo.uncorrectableChunks;
+                    qSort(chunks);
+                    exportInfo.listFileEccUncorrectable.append(item);
+                } else if (fileState->eccInfo.numCorrected > 0) {
+                    exportInfo.listFileEccCorrected.append(item);
+                }
+            } else {
+                exportInfo.listFileExportFailures.append(item);
+            }
+            delete fileState;
+        }
+    };
+
+    //exports one file on a worker, all workers read through the same open YaffsControl. the file is created here and
+    //its parts after the first are queued on the same pool, so a large file is read and checked on every worker.
+    class ExportFileTask : public QRunnable {
+    public:
+        ExportFileTask(const YaffsControl& control, QThreadPool& exportPool, const YaffsItem* exportItem, int dataHeaderPos,
+                       const QString& exportPath, bool verify, YaffsExportInfo& info, QMutex& mutex) :
+            yaffsControl(control), pool(exportPool), item(exportItem), headerPos(dataHeaderPos), path(exportPath), verifyDataEcc(verify),
+            exportInfo(info), exportInfoMutex(mutex) {
+        }
+
+        const YaffsControl& yaffsControl;
+        QThreadPool& pool;
+        const YaffsItem* item;
+        int headerPos;                  //where the data is, for a hard link the header of the file it shares data with
+        QString path;
+        bool verifyDataEcc;
+        YaffsExportInfo& exportInfo;
+        QMutex& exportInfoMutex;
+
+        void run() {
+            bool created = false;
+            YaffsFile yaffsFile;
+            QFile file(path + QDir::separator() + item->getName());
+            if (yaffsControl.findFile(headerPos, yaffsFile) && file.open(QIODevice::WriteOnly)) {
+                created = file.resize(yaffsFile.size);
+                file.close();
+                if (!created) {
+                    file.remove();
+                }
+            }
+
+            if (!created) {
+                QMutexLocker locker(&exportInfoMutex);
+                exportInfo.listFileExportFailures.append(item);
+                return;
+            }
+
+            int numParts = qMax<long>((yaffsFile.size + EXPORT_PART_SIZE - 1) / EXPORT_PART_SIZE, 1);
+            ExportFileState* state = new ExportFileState(item, file.fileName(), yaffsFile, numParts);
+            for (int part = 1; part < numParts; ++part) {
+                pool.start(new ExportPartTask(yaffsControl, state, static_cast<long>(part) * EXPORT_PART_SIZE, verifyDataEcc,
+                                              exportInfo, exportInfoMutex));
+            }
+
+            ExportPartTask firstPart(yaffsControl, state, 0, verifyDataEcc, exportInfo, exportInfoMutex);
+            firstPart.run();
+        }
+    };
+}
 
 YaffsManager* YaffsManager::mSelf = new YaffsManager();
 
@@ -41,19 +202,48 @@ YaffsModel* YaffsManager::newModel() {
     mYaffsModel = new YaffsModel();
     connect(mYaffsModel, SIGNAL(dataChanged(const QModelIndex&, const QModelIndex&)), SLOT(on_model_DataChanged(QModelIndex, QModelIndex)));
     connect(mYaffsModel, SIGNAL(layoutChanged()), SLOT(on_model_LayoutChanged()));
+    connect(mYaffsModel, SIGNAL(rowsInserted(const QModelIndex&, int, int)), SLOT(on_model_RowsChanged(QModelIndex, int, int)));
+    connect(mYaffsModel, SIGNAL(rowsRemoved(const QModelIndex&, int, int)), SLOT(on_model_RowsChanged(QModelIndex, int, int)));
     return mYaffsModel;
 }
 
-YaffsExportInfo* YaffsManager::exportItems(QModelIndexList itemIndices, const QString& path) {
+YaffsExportInfo* YaffsManager::exportItems(QModelIndexList itemIndices, const QString& path, bool verifyDataEcc) {
     mYaffsExportInfo = new YaffsExportInfo();
     mYaffsExportInfo->numDirsExported = 0;
     mYaffsExportInfo->numFilesExported = 0;
 
+    //directories are made here in tree order, their files are only queued
+    mExportFiles.clear();
     foreach (QModelIndex index, itemIndices) {
         YaffsItem* item = static_cast<YaffsItem*>(index.internalPointer());
+        mYaffsModel->fetchAll(item);
         exportItem(item, path);
     }
 
+    if (mExportFiles.size() > 0) {
+        QString imageFilename = mYaffsModel->getImageFilename();
+        YaffsControl yaffsControl(imageFilename.toStdString().c_str(), NULL);
+        yaffsControl.setChunkMap(mYaffsModel->getChunkMap());
+        yaffsControl.setOobLayout(mYaffsModel->getOobLayout());
+        if (yaffsControl.open(YaffsControl::OPEN_READ)) {
+            QThreadPool pool;
+            QMutex exportInfoMutex;
+            pool.setMaxThreadCount(QThread::idealThreadCount());
+            for (int i = 0; i < mExportFiles.size(); ++i) {
+                const QPair<const YaffsItem*, QString>& exportFile = mExportFiles.at(i);
+                pool.start(new ExportFileTask(yaffsControl, pool, exportFile.first, mYaffsModel->getDataHeaderPosition(exportFile.first),
+                                              exportFile.second, verifyDataEcc,
+                                              *mYaffsExportInfo, exportInfoMutex));
+            }
+            pool.waitForDone();
+        } else {
+            for (int i = 0; i < mExportFiles.size(); ++i) {
+                mYaffsExportInfo->listFileExportFailures.append(mExportFiles.at(i).first);
+            }
+        }
+        mExportFiles.clear();
+    }
+
     return mYaffsExportInfo;
 }
 
@@ -65,9 +255,13 @@ void YaffsManager::on_model_LayoutChanged() {
     emit modelChanged();
 }
 
+void YaffsManager::on_model_RowsChanged(const QModelIndex& parentIndex, int first, int last) {
+    emit modelChanged();
+}
+
 void YaffsManager::exportItem(const YaffsItem* item, const QString& path) {
     if (item) {
-        if (item->isFile()) {
+        if (item->isFile() || item->isHardLink()) {
             exportFile(item, path);
         } else if (item->isDir()) {
             exportDirectory(item, path);
@@ -76,24 +270,9 @@ void YaffsManager::exportItem(const YaffsItem* item, const QString& path) {
 }
 
 void YaffsManager::exportFile(const YaffsItem* item, const QString& path) {
-    bool result = false;
-    if (item->isFile() && item->getCondition() != YaffsItem::NEW) {
-        int headerPosition = item->getHeaderPosition();
-        int filesize = item->getFileSize();
-        QString imageFilename = mYaffsModel->getImageFilename();
-        YaffsControl yaffsControl(imageFilename.toStdString().c_str(), NULL);
-        if (yaffsControl.open(YaffsControl::OPEN_READ)) {
-            char* data = yaffsControl.extractFile(headerPosition);
-            if (data != NULL) {
-                QDir().mkpath(path);
-                result = saveDataToFile(path + QDir::separator() + item->getName(), data, filesize);
-                delete data;
-            }
-        }
-    }
-
-    if (result) {
-        mYaffsExportInfo->numFilesExported++;
+    //a file exported on its own may be going into a directory that doesn't exist yet
+    if ((item->isFile() || item->isHardLink()) && item->getCondition() != YaffsItem::NEW && QDir().mkpath(path)) {
+        mExportFiles.append(qMakePair(item, path));
     } else {
         mYaffsExportInfo->listFileExportFailures.append(item);
     }
@@ -125,14 +304,3 @@ void YaffsManager::exportDirectory(const YaffsItem* item, const QString& path) {
         mYaffsExportInfo->listDirExportFailures.append(item);
     }
 }
-
-bool YaffsManager::saveDataToFile(const QString& filename, const char* data, int length) {
-    bool result = false;
-    QFile file(filename);
-    bool open = file.open(QIODevice::WriteOnly);
-    if (open) {
-        result = (file.write(data, length) != -1);
-        file.close();
-    }
-    return result;
-}
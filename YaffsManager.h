@@ -21,14 +21,20 @@
 
 #include <QList>
 #include <QFile>
+#include <QPair>
+#include <QHash>
 
 #include "YaffsModel.h"
+#include "YaffsControl.h"
 
 struct YaffsExportInfo {
     int numFilesExported;
     int numDirsExported;
     QList<const YaffsItem*> listFileExportFailures;
     QList<const YaffsItem*> listDirExportFailures;
+    QList<const YaffsItem*> listFileEccCorrected;       //exported, with single bit errors corrected
+    QList<const YaffsItem*> listFileEccUncorrectable;   //exported, but with data that couldn't be corrected
+    QHash<const YaffsItem*, QList<u32> > fileEccUncorrectableChunks;    //chunk ids of each of those, in order
 };
 
 class YaffsManager : public QObject {
@@ -39,7 +45,7 @@ public:
     ~YaffsManager();
 
     YaffsModel* newModel();
-    YaffsExportInfo* exportItems(QModelIndexList itemIndices, const QString& path);
+    YaffsExportInfo* exportItems(QModelIndexList itemIndices, const QString& path, bool verifyDataEcc);
     YaffsModel* getModel() { return mYaffsModel; }
 
 signals:
@@ -48,18 +54,19 @@ signals:
 private slots:
     void on_model_DataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight);
     void on_model_LayoutChanged();
+    void on_model_RowsChanged(const QModelIndex& parentIndex, int first, int last);
 
 private:
     YaffsManager();
     void exportItem(const YaffsItem* item, const QString& path);
     void exportFile(const YaffsItem* item, const QString& path);
     void exportDirectory(const YaffsItem* item, const QString& path);
-    bool saveDataToFile(const QString& filename, const char* data, int length);
 
 private:
     static YaffsManager* mSelf;
     YaffsModel* mYaffsModel;
     YaffsExportInfo* mYaffsExportInfo;
+    QList<QPair<const YaffsItem*, QString> > mExportFiles;     //files waiting for their directories to be made
 };
 
 #endif  //YAFFSMANAGER_H
@@ -18,23 +18,92 @@
 
 #include <QtGui>
 
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#endif  //Q_OS_UNIX
+
 #include "YaffsModel.h"
+#include "YaffsIndex.h"
+#include "YaffsFileDevice.h"
+
+//read at a time when hashing files to find duplicates
+#define HASH_BUFFER_SIZE    (64 * 1024)
+
+namespace {
+    //hashes the first length bytes of a file, from the image when sourceImage is given or else from outside it
+    class HashTask : public QRunnable {
+    public:
+        HashTask(const YaffsControl* sourceImage, int sourceHeaderPos, const QString& externalFilename, long length, QByteArray* hashResult) :
+            yaffsControl(sourceImage), headerPos(sourceHeaderPos), filename(externalFilename), fileSize(length), result(hashResult) {
+        }
+
+        const YaffsControl* yaffsControl;
+        int headerPos;
+        QString filename;
+        long fileSize;
+        QByteArray* result;         //left empty if the file can't be read
+
+        void run() {
+            //files in the image and outside it are both read as a QIODevice
+            QIODevice* device = NULL;
+            YaffsFile yaffsFile;
+            if (yaffsControl == NULL) {
+                device = new QFile(filename);
+            } else if (yaffsControl->findFile(headerPos, yaffsFile)) {
+                device = new YaffsFileDevice(*yaffsControl, yaffsFile);
+            }
+
+            if (device && device->open(QIODevice::ReadOnly)) {
+                QCryptographicHash hash(QCryptographicHash::Sha1);
+                QByteArray buffer(HASH_BUFFER_SIZE, 0);
+                long offset = 0;
+                while (offset < fileSize) {
+                    long length = qMin<long>(HASH_BUFFER_SIZE, fileSize - offset);
+                    if (device->read(buffer.data(), length) != length) {
+                        break;
+                    }
+                    hash.addData(buffer.constData(), length);
+                    offset += length;
+                }
+
+                if (offset == fileSize) {
+                    *result = hash.result();
+                }
+            }
+            delete device;
+        }
+    };
+}
 
 YaffsModel::YaffsModel(QObject* parent) : QAbstractItemModel(parent) {
     mYaffsRoot = NULL;
+    mHeaderControl = NULL;
     mYaffsSaveControl = NULL;
+    mYaffsSourceControl = NULL;
+    mYaffsWriter = NULL;
+    mSaveThreads = QThread::idealThreadCount();
+    mDeduplicate = false;
+    mVerifyTags = false;
+    mOobLayout = 0;
 
     mItemsNew = 0;
-    mItemsDirty = 0;
     mItemsDeleted = 0;
+    mItemsWithoutHeader = 0;
+    mItemsCreated = 0;
+
+    mImporter = NULL;
+
+    mTransactionDepth = 0;
 }
 
 YaffsModel::~YaffsModel() {
+    delete mImporter;
+    delete mHeaderControl;
     delete mYaffsRoot;
 }
 
 void YaffsModel::newImage(const QString& newImageName) {
-    mYaffsRoot = YaffsItem::createRoot();
+    mYaffsRoot = YaffsItem::createRoot(&mObjectTable);
     mItemsNew++;
     mImageFilename = newImageName;
 
@@ -48,17 +117,33 @@ YaffsReadInfo YaffsModel::openImage(const QString& imageFilename) {
     memset(&readInfo, 0, sizeof(YaffsReadInfo));
 
     if (mYaffsRoot == NULL) {
-        YaffsControl yaffsControl(mImageFilename.toStdString().c_str(), this);
-        if (yaffsControl.open(YaffsControl::OPEN_READ)) {
-            if (yaffsControl.readImage()) {
-                readInfo = yaffsControl.getReadInfo();
+        //an index from an earlier scan of the same image avoids scanning it again, unless the tags are to be verified
+        YaffsIndex yaffsIndex(mImageFilename, mOobLayout, this);
+        if (!mVerifyTags && yaffsIndex.load(readInfo, mChunkMap)) {
+            qDebug() << "Loaded index for " << mImageFilename;
+        } else {
+            YaffsControl yaffsControl(mImageFilename.toStdString().c_str(), &yaffsIndex);
+            if (yaffsControl.open(YaffsControl::OPEN_READ)) {
+                //names and the rest of the headers are read when a directory is expanded
+                yaffsControl.setScanMode(YaffsControl::SCAN_TAGS_ONLY);
+                yaffsControl.setScanOrder(YaffsControl::SCAN_BACKWARDS);
+                yaffsControl.setVerifyTags(mVerifyTags);
+                yaffsControl.setOobLayout(mOobLayout);
+                if (yaffsControl.readImage()) {
+                    readInfo = yaffsControl.getReadInfo();
+                    mChunkMap = yaffsControl.getChunkMap();
+                    yaffsIndex.save(readInfo, mChunkMap);
+                }
+            }
+        }
 
-                mItemsNew = 0;
-                mItemsDirty = 0;
-                mItemsDeleted = 0;
+        if (readInfo.result) {
+            mItemsNew = 0;
+            mDirtyItems.clear();
+            mItemsDeleted = 0;
+            mDeletedRows.clear();
 
-                emit layoutChanged();
-            }
+            emit layoutChanged();
         }
     }
 
@@ -71,106 +156,548 @@ void YaffsModel::importFile(YaffsItem* parentItem, const QString& filenameWithPa
         int filesize = fileInfo.size();
 
         YaffsItem* importedFile = YaffsItem::createFile(parentItem, filenameWithPath, filesize);
-        parentItem->appendChild(importedFile);
+        insertItem(parentItem, importedFile);
 
         mItemsNew++;
-        emit layoutChanged();
     }
 }
 
-void YaffsModel::importDirectory(YaffsItem* parentItem, const QString& directoryName) {
-    if (parentItem && directoryName.length() > 0) {
-        YaffsItem* newDir = YaffsItem::createDirectory(parentItem, directoryName);
-        parentItem->appendChild(newDir);
-        mItemsNew++;
+//the host tree is read on other threads and added to the model in one go when it is complete. parentItem is held
+//by a persistent index, so if it is deleted in the meantime the tree is dropped and importFinished() reports nothing.
+bool YaffsModel::importDirectory(YaffsItem* parentItem, const QString& directoryName) {
+    if (parentItem && directoryName.length() > 0 && mImporter == NULL) {
+        mImporter = new YaffsImporter(directoryName);
+        mImportParent = createIndex(parentItem->row(), 0, parentItem);
+        connect(mImporter, SIGNAL(progress(int)), SIGNAL(importProgress(int)));
+        connect(mImporter, SIGNAL(finished()), SLOT(on_importer_finished()));
+        mImporter->start();
+        return true;
+    }
+    return false;
+}
+
+void YaffsModel::cancelImport() {
+    if (mImporter) {
+        mImporter->cancel();
+    }
+}
+
+void YaffsModel::on_importer_finished() {
+    int itemsImported = 0;
+    if (mImporter) {
+        YaffsImportEntry* tree = mImporter->takeTree();
+        YaffsItem* parentItem = (mImportParent.isValid() ? static_cast<YaffsItem*>(mImportParent.internalPointer()) : NULL);
+        if (tree && parentItem) {
+            insertItem(parentItem, createImportedItems(parentItem, tree, itemsImported));
+            mItemsNew += itemsImported;
+        }
+        delete tree;
+
+        //the last task may still be returning to the pool
+        mImporter->deleteLater();
+        mImporter = NULL;
+        mImportParent = QPersistentModelIndex();
+    }
+
+    emit importFinished(itemsImported);
+}
+
+//the items below the one returned are added straight away, the view only needs telling about the one at the top
+YaffsItem* YaffsModel::createImportedItems(YaffsItem* parentItem, const YaffsImportEntry* entry, int& itemsCreated) {
+    YaffsItem* item = NULL;
+    if (entry->isDir) {
+        item = YaffsItem::createDirectory(parentItem, entry->path);
+        foreach (const YaffsImportEntry* childEntry, entry->children) {
+            item->appendChild(createImportedItems(item, childEntry, itemsCreated));
+        }
+    } else {
+        item = YaffsItem::createFile(parentItem, entry->path, entry->fileSize);
+    }
+    itemsCreated++;
+    return item;
+}
+
+//changes made until the matching commitTransaction() are shown in one go, rows added with insertItem() and removed with
+//deleteRows() are held back until then and setData() changes are gathered into one dataChanged() per directory.
+//transactions can be nested.
+void YaffsModel::beginTransaction() {
+    mTransactionDepth++;
+}
+
+void YaffsModel::commitTransaction() {
+    if (mTransactionDepth > 0 && --mTransactionDepth == 0) {
+        emitPendingChanges();
+    }
+}
 
-        QDirIterator dirs(directoryName, QDirIterator::NoIteratorFlags);
-        while (dirs.hasNext()) {
-            QFileInfo fileInfo(dirs.next());
-            QString fileName = fileInfo.fileName();
-            QString fileNameWithPath = fileInfo.absoluteFilePath();
+void YaffsModel::insertItem(YaffsItem* parentItem, YaffsItem* item) {
+    if (mTransactionDepth > 0) {
+        if (!mPendingInserts.contains(parentItem)) {
+            mPendingParents.append(parentItem);
+        }
+        mPendingInserts[parentItem].append(item);
+    } else {
+        int row = parentItem->childCount();
+        beginInsertRows(createIndex(parentItem->row(), 0, parentItem), row, row);
+        parentItem->appendChild(item);
+        endInsertRows();
+    }
+}
+
+void YaffsModel::itemChanged(YaffsItem* item, const QModelIndex& itemIndex) {
+    if (mTransactionDepth > 0) {
+        mChangedItems.insert(item);
+    } else {
+        emit dataChanged(itemIndex, itemIndex);
+    }
+}
+
+//true if the item, or a directory above it, is about to be removed
+static bool isRemoved(const YaffsItem* item, const QSet<YaffsItem*>& removedItems) {
+    for (; item; item = item->parent()) {
+        if (removedItems.contains(const_cast<YaffsItem*>(item))) {
+            return true;
+        }
+    }
+    return false;
+}
 
-            if (fileInfo.isDir()) {
-                if (fileName != "." && fileName != "..") {
-                    importDirectory(newDir, fileNameWithPath);
+void YaffsModel::emitPendingChanges() {
+    //removals go first, while the rows queued are still where they were. anything held back below a removed item goes with it,
+    //so all of that is worked out before any item is deleted.
+    if (!mPendingRemovals.isEmpty()) {
+        QSet<YaffsItem*> removedItems;
+        QHash<YaffsItem*, QSet<YaffsItem*> >::const_iterator r;
+        for (r = mPendingRemovals.constBegin(); r != mPendingRemovals.constEnd(); ++r) {
+            removedItems.unite(r.value());
+        }
+
+        QHash<YaffsItem*, QList<int> > removedRows;
+        for (r = mPendingRemovals.constBegin(); r != mPendingRemovals.constEnd(); ++r) {
+            if (!isRemoved(r.key(), removedItems)) {
+                QList<int>& rows = removedRows[r.key()];
+                foreach (const YaffsItem* item, r.value()) {
+                    rows.append(item->row());
                 }
-            } else if (fileInfo.isFile()) {
-                importFile(newDir, fileNameWithPath);
             }
         }
+        mPendingRemovals.clear();
+
+        QSet<YaffsItem*>::iterator c = mChangedItems.begin();
+        while (c != mChangedItems.end()) {
+            if (isRemoved(*c, removedItems)) {
+                c = mChangedItems.erase(c);
+            } else {
+                ++c;
+            }
+        }
+
+        //a new directory is given rows after its parent, so going backwards its own rows are dropped before it is
+        for (int i = mPendingParents.size() - 1; i >= 0; --i) {
+            if (isRemoved(mPendingParents.at(i), removedItems)) {
+                qDeleteAll(mPendingInserts.take(mPendingParents.at(i)));
+                mPendingParents.removeAt(i);
+            }
+        }
+
+        QHash<YaffsItem*, QList<int> >::iterator rows;
+        for (rows = removedRows.begin(); rows != removedRows.end(); ++rows) {
+            calculateAndDeleteContiguousRows(rows.value(), rows.key());
+        }
+    }
+
+    //parents are done in the order they were first given a row, so a new directory is in the model before its own rows are
+    foreach (YaffsItem* parentItem, mPendingParents) {
+        const QList<YaffsItem*>& items = mPendingInserts[parentItem];
+        int firstRow = parentItem->childCount();
+        beginInsertRows(createIndex(parentItem->row(), 0, parentItem), firstRow, firstRow + items.size() - 1);
+        foreach (YaffsItem* item, items) {
+            parentItem->appendChild(item);
+        }
+        endInsertRows();
+    }
+    mPendingParents.clear();
+    mPendingInserts.clear();
+
+    QHash<YaffsItem*, QPair<int, int> > changedRows;        //first and last row changed, by parent
+    foreach (YaffsItem* item, mChangedItems) {
+        int row = item->row();
+        QHash<YaffsItem*, QPair<int, int> >::iterator rows = changedRows.find(item->parent());
+        if (rows == changedRows.end()) {
+            changedRows.insert(item->parent(), qMakePair(row, row));
+        } else {
+            rows.value().first = qMin(rows.value().first, row);
+            rows.value().second = qMax(rows.value().second, row);
+        }
+    }
+    mChangedItems.clear();
 
-        emit layoutChanged();
+    QHash<YaffsItem*, QPair<int, int> >::const_iterator i;
+    for (i = changedRows.constBegin(); i != changedRows.constEnd(); ++i) {
+        YaffsItem* parentItem = i.key();
+        QModelIndex parentIndex = (parentItem ? createIndex(parentItem->row(), 0, parentItem) : QModelIndex());
+        emit dataChanged(index(i.value().first, 0, parentIndex), index(i.value().second, YaffsItem::COLUMN_COUNT - 1, parentIndex));
+    }
+}
+
+void YaffsModel::fetchAll(YaffsItem* dirItem) {
+    if (dirItem) {
+        createChildItems(dirItem, true);
+        loadHeaders(dirItem, true);
+    }
+}
+
+void YaffsModel::releaseChildItems(const QModelIndex& dirIndex) {
+    YaffsItem* dirItem = static_cast<YaffsItem*>(dirIndex.internalPointer());
+    if (dirIndex.isValid() && dirItem && dirItem != mYaffsRoot && mItemsCreated > MAX_ITEMS_BEFORE_RELEASE) {
+        //the directory an import goes into is kept, along with everything above it
+        const YaffsItem* importParent = (mImportParent.isValid() ? static_cast<const YaffsItem*>(mImportParent.internalPointer()) : NULL);
+        while (importParent && importParent != dirItem) {
+            importParent = importParent->parent();
+        }
+
+        int childCount = dirItem->childCount();
+        if (childCount > 0 && importParent == NULL && isSubtreeClean(dirItem)) {
+            beginRemoveRows(dirIndex, 0, childCount - 1);
+            for (int i = 0; i < childCount; ++i) {
+                YaffsItem* childItem = dirItem->child(i);
+                storeItem(childItem);
+                delete childItem;
+            }
+            dirItem->clear();
+            dirItem->setHasChildWithoutHeader(false);
+            endRemoveRows();
+        }
+    }
+}
+
+void YaffsModel::createChildItems(YaffsItem* dirItem, bool recursive) {
+    QVector<int> childRows = mChildRows.take(dirItem->getObjectId());
+    if (childRows.size() > 0) {
+        int firstRow = dirItem->childCount();
+        QModelIndex dirIndex = createIndex(dirItem->row(), 0, dirItem);
+
+        beginInsertRows(dirIndex, firstRow, firstRow + childRows.size() - 1);
+        foreach (int objectRow, childRows) {
+            YaffsItem* childItem = new YaffsItem(dirItem, &mObjectTable, objectRow);
+            if (!childItem->isHeaderLoaded()) {
+                dirItem->setHasChildWithoutHeader(true);
+            }
+            dirItem->appendChild(childItem);
+        }
+        mItemsCreated += childRows.size();
+        endInsertRows();
+    }
+
+    if (recursive) {
+        int childCount = dirItem->childCount();
+        for (int i = 0; i < childCount; ++i) {
+            YaffsItem* childItem = dirItem->child(i);
+            if (childItem->isDir()) {
+                createChildItems(childItem, true);
+            }
+        }
+    }
+}
+
+//hands an item and everything below it back to the object table, the caller deletes the item
+void YaffsModel::storeItem(const YaffsItem* item) {
+    mChildRows[item->parent()->getObjectId()].append(item->getObjectRow());
+    mItemsCreated--;
+
+    int childCount = item->childCount();
+    for (int i = 0; i < childCount; ++i) {
+        storeItem(item->child(i));
+    }
+}
+
+//true if nothing below the item differs from the image
+bool YaffsModel::isSubtreeClean(const YaffsItem* item) const {
+    int childCount = item->childCount();
+    for (int i = 0; i < childCount; ++i) {
+        const YaffsItem* childItem = item->child(i);
+        if (childItem->getCondition() != YaffsItem::CLEAN || childItem->getObjectId() < 0 || !isSubtreeClean(childItem)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//drops the objects below a deleted item that never got an item of their own
+void YaffsModel::discardObjects(YaffsItem* item) {
+    discardChildRows(item->getObjectId());
+    mDirtyItems.remove(item);
+    if (item->getObjectId() >= 0) {
+        mDeletedRows.append(item->getObjectRow());
+    }
+
+    int childCount = item->childCount();
+    for (int i = 0; i < childCount; ++i) {
+        discardObjects(item->child(i));
+    }
+}
+
+//the rows stay in the table unused until the model goes away
+void YaffsModel::discardChildRows(int objectId) {
+    foreach (int objectRow, mChildRows.take(objectId)) {
+        mDeletedRows.append(objectRow);
+        discardChildRows(mObjectTable.getObjectId(objectRow));
+    }
+}
+
+//opened on the first directory expanded, rather than once for every one of them
+YaffsControl* YaffsModel::getHeaderControl() {
+    if (mHeaderControl == NULL) {
+        mHeaderControl = new YaffsControl(mImageFilename.toStdString().c_str(), NULL);
+        mHeaderControl->setOobLayout(mOobLayout);
+        if (!mHeaderControl->open(YaffsControl::OPEN_READ)) {
+            closeHeaderControl();
+        }
+    }
+    return mHeaderControl;
+}
+
+//before the image is written to or replaced, a mapping wouldn't see pages appended to it
+void YaffsModel::closeHeaderControl() {
+    delete mHeaderControl;
+    mHeaderControl = NULL;
+}
+
+void YaffsModel::loadHeaders(YaffsItem* dirItem, bool recursive) {
+    if (dirItem && mItemsWithoutHeader > 0 && (recursive || dirItem->hasChildWithoutHeader())) {
+        YaffsControl* yaffsControl = getHeaderControl();
+        if (yaffsControl) {
+            loadHeaders(*yaffsControl, dirItem, recursive);
+        }
+    }
+}
+
+void YaffsModel::loadHeaders(YaffsControl& yaffsControl, YaffsItem* dirItem, bool recursive) {
+    bool allLoaded = true;
+    yaffs_obj_hdr header;
+
+    int childCount = dirItem->childCount();
+    for (int i = 0; i < childCount; ++i) {
+        YaffsItem* childItem = dirItem->child(i);
+        if (!childItem->isHeaderLoaded()) {
+            if (yaffsControl.readHeader(childItem->getHeaderPosition(), header)) {
+                childItem->setHeader(header);
+                int targetRow = mHardLinkTargets.value(childItem->getObjectRow(), -1);
+                if (targetRow != -1) {
+                    mObjectTable.setFileSize(childItem->getObjectRow(), mObjectTable.getFileSize(targetRow));
+                }
+                mItemsWithoutHeader--;
+            } else {
+                qDebug() << "failed to read header at: " << childItem->getHeaderPosition();
+                allLoaded = false;
+            }
+        }
+
+        if (recursive && childItem->isDir()) {
+            loadHeaders(yaffsControl, childItem, recursive);
+        }
+    }
+
+    if (allLoaded) {
+        dirItem->setHasChildWithoutHeader(false);
     }
 }
 
 bool YaffsModel::save() {
     bool saved = false;
-/*
-    if (isDirty()) {
+
+    if (isDirty() && !isNewImage()) {
+        closeHeaderControl();
         if (mItemsNew > 0 || mItemsDeleted > 0) {
-            QString originalFilename = mImageFilename;
-            QString tmpFilename = mImageFilename + ".tmp";
-            saved = saveAs(tmpFilename);
-            if (saved) {
-                QFile::remove(mImageFilename);
-                QFile::rename(tmpFilename, mImageFilename);
-                mImageFilename = originalFilename;
-            }
+            saved = saveIncremental();
         } else {
-            YaffsControl yaffsControl(mImageFilename.toStdString().c_str(), NULL);
-
-            if (yaffsControl.open(YaffsControl::OPEN_MODIFY)) {
-                QMap<int, YaffsItem*>::const_iterator i;
-                for (i = mYaffsObjectsItemMap.begin(); i != mYaffsObjectsItemMap.end(); i++) {
-                    YaffsItem* item = i.value();
-                    if (item->getCondition() == YaffsItem::DIRTY) {
-                        int headerPos = item->getHeaderPosition();
-                        const yaffs_obj_hdr& header = item->getHeader();
-                        int objectId = item->getObjectId();
-
-                        if (yaffsControl.updateHeader(headerPos, header, objectId)) {
-                            item->setCondition(YaffsItem::CLEAN);
-                        }
-                    }
-                }
-                saved = true;
-            }
+            saved = saveHeaders();
         }
 
         if (saved) {
-            mItemsNew = 0;
-            mItemsDirty = 0;
-            mItemsDeleted = 0;
-
             QModelIndex root = index(0, 0);
             if (root.isValid()) {
                 emit dataChanged(root, root);
             }
         }
-    }*/
+    }
 
     return saved;
 }
 
-YaffsSaveInfo YaffsModel::saveAs(const QString& filename) {
+//only headers were edited, so each one is rewritten where it is in the image
+bool YaffsModel::saveHeaders() {
+    bool saved = false;
+
+    YaffsControl yaffsControl(mImageFilename.toStdString().c_str(), NULL);
+    yaffsControl.setOobLayout(mOobLayout);
+    if (yaffsControl.open(YaffsControl::OPEN_MODIFY)) {
+        saved = true;
+        foreach (YaffsItem* item, mDirtyItems) {
+            if (yaffsControl.updateHeader(item->getHeaderPosition(), item->getHeader(), item->getObjectId())) {
+                item->setCondition(YaffsItem::CLEAN);
+                mDirtyItems.remove(item);
+            } else {
+                saved = false;
+            }
+        }
+        saved = (yaffsControl.flush() && saved);
+    }
+
+    return saved;
+}
+
+//objects were added or deleted, so the changes are appended to the image the way YAFFS2 itself would write them
+//and the pages already there are left alone. a scan of the image then finds the newest state.
+bool YaffsModel::saveIncremental() {
+    bool saved = false;
+
+    //new objects get ids above any still in the table, deleted ones included
+    int nextObjectId = YAFFS_NOBJECT_BUCKETS + 1;
+    for (int row = 0; row < mObjectTable.size(); ++row) {
+        nextObjectId = qMax(nextObjectId, mObjectTable.getObjectId(row) + 1);
+    }
+
+    mYaffsSaveControl = new YaffsControl(mImageFilename.toStdString().c_str(), NULL);
+    mYaffsSaveControl->setOobLayout(mOobLayout);
+    mYaffsSaveControl->setNextObjectId(nextObjectId);
+    if (mYaffsSaveControl->open(YaffsControl::OPEN_APPEND)) {
+        saved = true;
+        yaffs_obj_hdr header;
+        foreach (int objectRow, mDeletedRows) {
+            mObjectTable.getHeader(objectRow, header);
+            saved = (mYaffsSaveControl->addDeletion(header, mObjectTable.getObjectId(objectRow)) && saved);
+        }
+
+        //only new files can become hard links, the ones already in the image are left as they are
+        if (mDeduplicate) {
+            findDuplicates(true);
+        }
+        saveChanges(mYaffsRoot);
+        saveHardLinks();
+
+        YaffsSaveInfo saveInfo = mYaffsSaveControl->getSaveInfo();
+        saved = (mYaffsSaveControl->flush() && saved && saveInfo.numDirsFailed + saveInfo.numFilesFailed + saveInfo.numSymLinksFailed +
+                                                        saveInfo.numHardLinksFailed == 0);
+
+        //the chunks of the new files are added to what is already known about the image. with no map at all
+        //(the image was read without mapping it) every file is found by walking from its header instead
+        if (!mChunkMap.isEmpty()) {
+            mChunkMap.append(mYaffsSaveControl->getChunkMap());
+            mChunkMap.build();
+        }
+    }
+    delete mYaffsSaveControl;
+    mYaffsSaveControl = NULL;
+    mDuplicateOf.clear();
+    mSavedObjectIds.clear();
+
+    if (saved) {
+        mItemsNew = 0;
+        mItemsDeleted = 0;
+        mDeletedRows.clear();
+    }
+
+    return saved;
+}
+
+//writes the new items below an item and newer headers for the edited ones
+void YaffsModel::saveChanges(YaffsItem* item) {
+    if (item->getCondition() == YaffsItem::DIRTY) {
+        int newHeaderPos = -1;
+        if (mYaffsSaveControl->addObjectHeader(item->getHeader(), item->getObjectId(), newHeaderPos)) {
+            item->setHeaderPosition(newHeaderPos);
+            item->setCondition(YaffsItem::CLEAN);
+            mDirtyItems.remove(item);
+        }
+    }
+
+    int childCount = item->childCount();
+    for (int i = 0; i < childCount; ++i) {
+        YaffsItem* childItem = item->child(i);
+        if (childItem->getCondition() == YaffsItem::NEW) {
+            childItem->setParentObjectId(item->getObjectId());
+            if (childItem->isDir()) {
+                saveDirectory(childItem);
+            } else if (childItem->isFile()) {
+                saveFile(childItem);
+            } else if (childItem->isSymLink()) {
+                saveSymLink(childItem);
+            }
+        } else {
+            saveChanges(childItem);
+        }
+    }
+}
+
+YaffsSaveInfo YaffsModel::saveAs(const QString& filename, int oobLayout) {
     YaffsSaveInfo saveInfo;
     memset(&saveInfo, 0, sizeof(YaffsSaveInfo));
 
     if (filename != mImageFilename) {
-        mYaffsSaveControl = new YaffsControl(filename.toStdString().c_str(), NULL);
-        if (mYaffsSaveControl->open(YaffsControl::OPEN_NEW)) {
-            saveDirectory(mYaffsRoot);
-            saveInfo = mYaffsSaveControl->getSaveInfo();
-            saveInfo.result = (saveInfo.numDirsFailed + saveInfo.numFilesFailed + saveInfo.numSymLinksFailed == 0);
+        fetchAll(mYaffsRoot);
+        if (mDeduplicate) {
+            findDuplicates(false);
+        }
+
+        bool written = false;
+        YaffsChunkMap chunkMap;
+        if (mSaveThreads > 1) {
+            //every page is placed while walking the tree, the data is read and written afterwards
+            mYaffsWriter = new YaffsWriter(filename, mImageFilename, mChunkMap, mOobLayout);
+            mYaffsWriter->setOobLayout(oobLayout);
+            if (mYaffsWriter->open()) {
+                saveDirectory(mYaffsRoot);
+                saveHardLinks();
+                written = mYaffsWriter->write(mSaveThreads);
+                saveInfo = mYaffsWriter->getSaveInfo();
+                chunkMap = mYaffsWriter->getChunkMap();
+            }
+        } else {
+            //a new image has no source, all of its files come from outside
+            mYaffsSourceControl = new YaffsControl(mImageFilename.toStdString().c_str(), NULL);
+            mYaffsSourceControl->setChunkMap(mChunkMap);
+            mYaffsSourceControl->setOobLayout(mOobLayout);
+            mYaffsSourceControl->open(YaffsControl::OPEN_READ);
+
+            mYaffsSaveControl = new YaffsControl(filename.toStdString().c_str(), NULL);
+            mYaffsSaveControl->setOobLayout(oobLayout);
+            if (mYaffsSaveControl->open(YaffsControl::OPEN_NEW)) {
+                saveDirectory(mYaffsRoot);
+                saveHardLinks();
+                written = mYaffsSaveControl->flush();
+                saveInfo = mYaffsSaveControl->getSaveInfo();
+                chunkMap = mYaffsSaveControl->getChunkMap();
+            }
         }
+        delete mYaffsWriter;
+        mYaffsWriter = NULL;
         delete mYaffsSaveControl;
         mYaffsSaveControl = NULL;
+        delete mYaffsSourceControl;
+        mYaffsSourceControl = NULL;
+        mPendingHardLinks.clear();
+        mDuplicateOf.clear();
+        mSavedObjectIds.clear();
+
+        saveInfo.result = (written && saveInfo.numDirsFailed + saveInfo.numFilesFailed + saveInfo.numSymLinksFailed +
+                                      saveInfo.numHardLinksFailed == 0);
+        if (saveInfo.result) {
+            mChunkMap = chunkMap;
+            mChunkMap.build();
+        }
 
         if (saveInfo.result) {
+            closeHeaderControl();
             mItemsNew = 0;
-            mItemsDirty = 0;
+            mDirtyItems.clear();
             mItemsDeleted = 0;
+            mDeletedRows.clear();
             mImageFilename = filename;
+            mOobLayout = oobLayout;
+
+            //every object has an item now, anything left in the table belongs to the old image
+            mChildRows.clear();
         }
     }
 
@@ -188,7 +715,13 @@ void YaffsModel::saveDirectory(YaffsItem* dirItem) {
 
         int newObjectId = -1;
         int newHeaderPos = -1;
-        if (parentItem) {
+        if (mYaffsWriter) {
+            if (parentItem) {
+                newObjectId = mYaffsWriter->addDirectory(dirItem->getHeader(), newHeaderPos);
+            } else {
+                newObjectId = mYaffsWriter->addRoot(dirItem->getHeader(), newHeaderPos);
+            }
+        } else if (parentItem) {
             newObjectId = mYaffsSaveControl->addDirectory(dirItem->getHeader(), newHeaderPos);
         } else {
             newObjectId = mYaffsSaveControl->addRoot(dirItem->getHeader(), newHeaderPos);
@@ -203,7 +736,7 @@ void YaffsModel::saveDirectory(YaffsItem* dirItem) {
 
             if (childItem->isDir()) {
                 saveDirectory(childItem);
-            } else if (childItem->isFile()) {
+            } else if (childItem->isFile() || childItem->isHardLink()) {
                 saveFile(childItem);
             } else if (childItem->isSymLink()) {
                 saveSymLink(childItem);
@@ -215,42 +748,60 @@ void YaffsModel::saveDirectory(YaffsItem* dirItem) {
 }
 
 void YaffsModel::saveFile(YaffsItem* fileItem) {
+    //hard links, and files with the same data as one already being written, go last
+    if (fileItem->isHardLink() || mDuplicateOf.contains(fileItem->getObjectRow())) {
+        mPendingHardLinks.append(fileItem);
+    } else {
+        writeFile(fileItem);
+    }
+}
+
+//a hard link written this way becomes a file with its own copy of the data
+void YaffsModel::writeFile(YaffsItem* fileItem) {
     if (fileItem) {
         YaffsItem* parentItem = fileItem->parent();
         qDebug() << "f: " << fileItem->getFullPath() << ", Parent: " << parentItem->getFullPath();
 
-        if (fileItem->isFile()) {
+        if (fileItem->isFile() || fileItem->isHardLink()) {
             YaffsItem::Condition condition = fileItem->getCondition();
+            yaffs_obj_hdr header = fileItem->getHeader();
+            header.type = YAFFS_OBJECT_TYPE_FILE;
+            int sourceHeaderPos = getDataHeaderPosition(fileItem);
             bool saved = false;
             int filesize = fileItem->getFileSize();
             int newObjectId = -1;
             int newHeaderPos = -1;
 
-            if (condition == YaffsItem::NEW) {
-                char* data = new char[filesize];
-                QString filename = fileItem->getExternalFilename();
-                FILE* file = fopen(filename.toStdString().c_str(), "rb");
-                if (file) {
-                    int bytesRead = fread(data, 1, filesize, file);
-                    if (bytesRead == filesize) {
-                        newObjectId = mYaffsSaveControl->addFile(fileItem->getHeader(), newHeaderPos, data, filesize);
-                        saved = true;
-                    }
+            if (mYaffsWriter) {
+                if (condition == YaffsItem::NEW) {
+                    newObjectId = mYaffsWriter->addFile(header, newHeaderPos, fileItem->getExternalFilename(), filesize);
+                } else {
+                    newObjectId = mYaffsWriter->addFile(header, newHeaderPos, sourceHeaderPos, filesize);
                 }
-                delete data;
-            } else {
-                int headerPosition = fileItem->getHeaderPosition();
-                YaffsControl yaffsControl(mImageFilename.toStdString().c_str(), NULL);
-                if (yaffsControl.open(YaffsControl::OPEN_READ)) {
-                    char* data = yaffsControl.extractFile(headerPosition);
-                    if (data != NULL) {
-                        newObjectId = mYaffsSaveControl->addFile(fileItem->getHeader(), newHeaderPos, data, filesize);
-                        saved = true;
-                    }
+                saved = (newObjectId != -1);
+            } else if (condition == YaffsItem::NEW) {
+                //streamed from the file a chunk at a time, however big it is
+                QFile file(fileItem->getExternalFilename());
+                if (file.open(QIODevice::ReadOnly) && file.size() >= filesize) {
+                    newObjectId = mYaffsSaveControl->addFile(header, newHeaderPos, file, filesize);
+                    saved = true;
+                }
+            } else if (mYaffsSourceControl) {
+                //the data pages are copied across from the source image without being decoded,
+                //as it always has been, an empty file in the source image isn't copied
+                YaffsFile sourceFile;
+                if (mYaffsSourceControl->findFile(sourceHeaderPos, sourceFile) && sourceFile.size > 0 && sourceFile.size >= filesize) {
+                    newObjectId = mYaffsSaveControl->addFile(header, newHeaderPos, *mYaffsSourceControl, sourceFile, filesize);
+                    saved = true;
                 }
             }
 
             if (saved) {
+                if (fileItem->isHardLink()) {
+                    fileItem->setHeader(header);
+                    mHardLinkTargets.remove(fileItem->getObjectRow());
+                }
+                mSavedObjectIds.insert(fileItem->getObjectRow(), newObjectId);
                 fileItem->setHeaderPosition(newHeaderPos);
                 fileItem->setObjectId(newObjectId);
                 fileItem->setCondition(YaffsItem::CLEAN);
@@ -265,7 +816,12 @@ void YaffsModel::saveSymLink(YaffsItem* symLinkItem) {
         if (parentItem) {
             qDebug() << "s: " << symLinkItem->getFullPath() << ", Parent: " << parentItem->getFullPath();
             int newHeaderPos = -1;
-            int newObjectId = mYaffsSaveControl->addSymLink(symLinkItem->getHeader(), newHeaderPos);
+            int newObjectId = -1;
+            if (mYaffsWriter) {
+                newObjectId = mYaffsWriter->addSymLink(symLinkItem->getHeader(), newHeaderPos);
+            } else {
+                newObjectId = mYaffsSaveControl->addSymLink(symLinkItem->getHeader(), newHeaderPos);
+            }
             symLinkItem->setHeaderPosition(newHeaderPos);
             symLinkItem->setObjectId(newObjectId);
             symLinkItem->setCondition(YaffsItem::CLEAN);
@@ -273,6 +829,199 @@ void YaffsModel::saveSymLink(YaffsItem* symLinkItem) {
     }
 }
 
+//hard links go last, once the files they share data with have their object ids in the new image
+void YaffsModel::saveHardLinks() {
+    //duplicates go before the existing hard links, which may point at one of them
+    QList<YaffsItem*> pending;
+    foreach (YaffsItem* linkItem, mPendingHardLinks) {
+        if (!linkItem->isHardLink()) {
+            pending.append(linkItem);
+        }
+    }
+    foreach (YaffsItem* linkItem, mPendingHardLinks) {
+        if (linkItem->isHardLink()) {
+            pending.append(linkItem);
+        }
+    }
+
+    foreach (YaffsItem* linkItem, pending) {
+        int objectRow = linkItem->getObjectRow();
+        int targetRow = (linkItem->isHardLink() ? mHardLinkTargets.value(objectRow, -1) : mDuplicateOf.value(objectRow));
+
+        //a target that was a duplicate itself and wasn't written is followed to the file that was
+        int equivId = mSavedObjectIds.value(targetRow, -1);
+        while (equivId == -1 && mDuplicateOf.contains(targetRow)) {
+            targetRow = mDuplicateOf.value(targetRow);
+            equivId = mSavedObjectIds.value(targetRow, -1);
+        }
+        if (equivId == -1) {
+            //that file wasn't written, so this one gets a copy of the data after all
+            writeFile(linkItem);
+            continue;
+        }
+
+        yaffs_obj_hdr header = linkItem->getHeader();
+        header.type = YAFFS_OBJECT_TYPE_HARDLINK;
+        header.equiv_id = equivId;
+        header.file_size_low = 0;
+
+        int newHeaderPos = -1;
+        int newObjectId = -1;
+        if (mYaffsWriter) {
+            newObjectId = mYaffsWriter->addHardLink(header, newHeaderPos);
+        } else {
+            newObjectId = mYaffsSaveControl->addHardLink(header, newHeaderPos);
+        }
+
+        if (newObjectId != -1) {
+            int fileSize = linkItem->getFileSize();
+            linkItem->setHeader(header);
+            mObjectTable.setFileSize(objectRow, fileSize);
+            mHardLinkTargets.insert(objectRow, targetRow);
+            linkItem->setHeaderPosition(newHeaderPos);
+            linkItem->setObjectId(newObjectId);
+            linkItem->setCondition(YaffsItem::CLEAN);
+        }
+    }
+    mPendingHardLinks.clear();
+}
+
+//finds files that would be written with the same data and attributes, every one but the first becomes a hard link to it.
+//a hard link has no attributes of its own, so everything it would give up is part of the match: mode, owner, device
+//and every time in the header. files are grouped by size and attributes first so that only files that could match are hashed.
+//with newFilesOnly, as when appending to the image, only new files become hard links, and files already in the image are
+//preferred as the one kept since they keep their object ids.
+void YaffsModel::findDuplicates(bool newFilesOnly) {
+    mDuplicateOf.clear();
+
+    QList<YaffsItem*> files;
+    collectFiles(mYaffsRoot, files);
+
+    QHash<QByteArray, QList<YaffsItem*> > groups;
+    foreach (YaffsItem* fileItem, files) {
+        if (fileItem->getFileSize() > 0) {
+            yaffs_obj_hdr header = fileItem->getHeader();
+            u32 attributes[] = { header.file_size_low, header.file_size_high, header.yst_mode, header.yst_uid, header.yst_gid,
+                                 header.yst_atime, header.yst_mtime, header.yst_ctime, header.yst_rdev,
+                                 header.win_ctime[0], header.win_ctime[1], header.win_atime[0], header.win_atime[1],
+                                 header.win_mtime[0], header.win_mtime[1] };
+            QList<YaffsItem*>& group = groups[QByteArray(reinterpret_cast<const char*>(attributes), sizeof(attributes))];
+            if (fileItem->getCondition() == YaffsItem::NEW) {
+                group.append(fileItem);
+            } else {
+                group.prepend(fileItem);
+            }
+        }
+    }
+
+    QList<YaffsItem*> candidates;
+    QList<QByteArray> candidateKeys;
+    QHash<QByteArray, QList<YaffsItem*> >::const_iterator i;
+    for (i = groups.constBegin(); i != groups.constEnd(); ++i) {
+        if (i.value().size() < 2) {
+            continue;
+        }
+
+        QList<YaffsItem*> groupCandidates;
+#ifdef Q_OS_UNIX
+        //files imported from one inode on the host were hard links there already and don't need hashing
+        QHash<QPair<quint64, quint64>, YaffsItem*> inodes;
+#endif  //Q_OS_UNIX
+        foreach (YaffsItem* fileItem, i.value()) {
+#ifdef Q_OS_UNIX
+            struct stat fileStat;
+            if (fileItem->getCondition() == YaffsItem::NEW &&
+                    stat(fileItem->getExternalFilename().toLocal8Bit().constData(), &fileStat) == 0) {
+                QPair<quint64, quint64> inode(fileStat.st_dev, fileStat.st_ino);
+                YaffsItem* firstItem = inodes.value(inode, NULL);
+                if (firstItem) {
+                    mDuplicateOf.insert(fileItem->getObjectRow(), firstItem->getObjectRow());
+                    continue;
+                }
+                inodes.insert(inode, fileItem);
+            }
+#endif  //Q_OS_UNIX
+            groupCandidates.append(fileItem);
+        }
+
+        if (newFilesOnly && groupCandidates.last()->getCondition() != YaffsItem::NEW) {
+            continue;
+        }
+        if (groupCandidates.size() > 1) {
+            candidates += groupCandidates;
+            for (int c = 0; c < groupCandidates.size(); ++c) {
+                candidateKeys.append(i.key());
+            }
+        }
+    }
+
+    if (candidates.size() > 0) {
+        YaffsControl yaffsControl(mImageFilename.toStdString().c_str(), NULL);
+        yaffsControl.setChunkMap(mChunkMap);
+        yaffsControl.setOobLayout(mOobLayout);
+        bool sourceOpen = yaffsControl.open(YaffsControl::OPEN_READ);
+
+        QVector<QByteArray> hashes(candidates.size());
+        QThreadPool pool;
+        for (int c = 0; c < candidates.size(); ++c) {
+            YaffsItem* fileItem = candidates.at(c);
+            if (fileItem->getCondition() == YaffsItem::NEW) {
+                pool.start(new HashTask(NULL, -1, fileItem->getExternalFilename(), fileItem->getFileSize(), &hashes[c]));
+            } else if (sourceOpen) {
+                pool.start(new HashTask(&yaffsControl, fileItem->getHeaderPosition(), QString(), fileItem->getFileSize(), &hashes[c]));
+            }
+        }
+        pool.waitForDone();
+
+        QHash<QByteArray, YaffsItem*> firstByContent;
+        for (int c = 0; c < candidates.size(); ++c) {
+            if (hashes.at(c).isEmpty()) {
+                continue;
+            }
+
+            QByteArray content = candidateKeys.at(c) + hashes.at(c);
+            YaffsItem* firstItem = firstByContent.value(content, NULL);
+            if (firstItem == NULL) {
+                firstByContent.insert(content, candidates.at(c));
+            } else if (!newFilesOnly || candidates.at(c)->getCondition() == YaffsItem::NEW) {
+                mDuplicateOf.insert(candidates.at(c)->getObjectRow(), firstItem->getObjectRow());
+                if (newFilesOnly && firstItem->getCondition() != YaffsItem::NEW) {
+                    mSavedObjectIds.insert(firstItem->getObjectRow(), firstItem->getObjectId());
+                }
+            }
+        }
+    }
+
+    //a host hard link to a file that turned out to be a duplicate itself points at the file that is written
+    QHash<int, int>::iterator d;
+    for (d = mDuplicateOf.begin(); d != mDuplicateOf.end(); ++d) {
+        while (mDuplicateOf.contains(d.value())) {
+            d.value() = mDuplicateOf.value(d.value());
+        }
+    }
+}
+
+void YaffsModel::collectFiles(YaffsItem* dirItem, QList<YaffsItem*>& files) {
+    int childCount = dirItem->childCount();
+    for (int i = 0; i < childCount; ++i) {
+        YaffsItem* childItem = dirItem->child(i);
+        if (childItem->isDir()) {
+            collectFiles(childItem, files);
+        } else if (childItem->isFile()) {
+            files.append(childItem);
+        }
+    }
+}
+
+//where to read the data of a file from, the file a hard link shares data with or -1 if that isn't known
+int YaffsModel::getDataHeaderPosition(const YaffsItem* item) const {
+    if (item->isHardLink()) {
+        int targetRow = mHardLinkTargets.value(item->getObjectRow(), -1);
+        return (targetRow != -1 ? mObjectTable.getHeaderPosition(targetRow) : -1);
+    }
+    return item->getHeaderPosition();
+}
+
 QVariant YaffsModel::data(const QModelIndex& itemIndex, int role) const {
     QVariant result = QVariant();
     YaffsItem* item = static_cast<YaffsItem*>(itemIndex.internalPointer());
@@ -291,6 +1040,8 @@ QVariant YaffsModel::data(const QModelIndex& itemIndex, int role) const {
                     result = QVariant(QColor(Qt::black));
                 } else if (item->isSymLink()) {
                     result = QVariant(QColor(Qt::darkGreen));
+                } else if (item->isHardLink()) {
+                    result = QVariant(QColor(Qt::darkCyan));
                 }
             }
         } else if (role == Qt::BackgroundRole) {
@@ -363,11 +1114,13 @@ bool YaffsModel::setData(const QModelIndex& itemIndex, const QVariant& value, in
                 break;
             }
         }
-        mItemsDirty += (item->getCondition() == YaffsItem::DIRTY ? 1 : 0);
+        if (item && item->getCondition() == YaffsItem::DIRTY) {
+            mDirtyItems.insert(item);
+        }
     }
 
     if (result) {
-        emit dataChanged(itemIndex, itemIndex);
+        itemChanged(static_cast<YaffsItem*>(itemIndex.internalPointer()), itemIndex);
     }
 
     return result;
@@ -472,11 +1225,21 @@ int YaffsModel::rowCount(const QModelIndex& parentIndex) const {
     return count;
 }
 
+bool YaffsModel::hasChildren(const QModelIndex& parentIndex) const {
+    if (!parentIndex.isValid()) {
+        return (mYaffsRoot != NULL);
+    }
+
+    YaffsItem* parent = static_cast<YaffsItem*>(parentIndex.internalPointer());
+    return (parent && (parent->childCount() > 0 || mChildRows.contains(parent->getObjectId())));
+}
+
 int YaffsModel::columnCount(const QModelIndex& parentIndex) const {
     return YaffsItem::COLUMN_COUNT;
 }
 
 int YaffsModel::removeRows(const QModelIndexList& selectedRows) {
+    //rows are removed as soon as their range is known, or at the commit during a transaction
     //mark all selected items for delete
     foreach (QModelIndex index, selectedRows) {
         YaffsItem* item = static_cast<YaffsItem*>(index.internalPointer());
@@ -489,6 +1252,20 @@ int YaffsModel::removeRows(const QModelIndexList& selectedRows) {
     return processChildItemsForDelete(mYaffsRoot);
 }
 
+bool YaffsModel::canFetchMore(const QModelIndex& parentIndex) const {
+    YaffsItem* parent = static_cast<YaffsItem*>(parentIndex.internalPointer());
+    return (parentIndex.isValid() && parent && (mChildRows.contains(parent->getObjectId()) || parent->hasChildWithoutHeader()));
+}
+
+void YaffsModel::fetchMore(const QModelIndex& parentIndex) {
+    YaffsItem* parent = static_cast<YaffsItem*>(parentIndex.internalPointer());
+    if (parentIndex.isValid() && parent) {
+        //the headers are in place before the view gets back to painting the rows just inserted
+        createChildItems(parent, false);
+        loadHeaders(parent, false);
+    }
+}
+
 int YaffsModel::processChildItemsForDelete(YaffsItem* item) {
     int itemsDeleted = 0;
     if (item->hasChildMarkedForDelete()) {
@@ -547,15 +1324,26 @@ int YaffsModel::calculateAndDeleteContiguousRows(QList<int>& rows, YaffsItem* pa
 int YaffsModel::deleteRows(int row, int count, const QModelIndex& parentIndex) {
     int itemsDeleted = 0;
 
+    if (parentIndex.isValid() && mTransactionDepth > 0) {
+        //the rows stay until the commit, so the rows given by later calls still line up
+        YaffsItem* parentItem = static_cast<YaffsItem*>(parentIndex.internalPointer());
+        QSet<YaffsItem*>& removals = mPendingRemovals[parentItem];
+        int numPending = removals.size();
+        for (int i = row; i < row + count; ++i) {
+            removals.insert(parentItem->child(i));
+        }
+        return removals.size() - numPending;
+    }
+
     if (parentIndex.isValid()) {
         beginRemoveRows(parentIndex, row, row + (count - 1));
         for (int i = row + (count - 1); i >= row; --i) {
             YaffsItem* parentItem = static_cast<YaffsItem*>(parentIndex.internalPointer());
+            discardObjects(parentItem->child(row));
             parentItem->removeChild(row);
             itemsDeleted++;
         }
         endRemoveRows();
-        emit layoutChanged();
     }
 
     mItemsDeleted += itemsDeleted;
@@ -563,47 +1351,58 @@ int YaffsModel::deleteRows(int row, int count, const QModelIndex& parentIndex) {
 }
 
 //from YaffsReaderObserver
-void YaffsModel::newItem(int yaffsObjectId, const yaffs_obj_hdr* yaffsObjectHeader, int fileOffset) {
+void YaffsModel::newItem(int yaffsObjectId, const yaffs_obj_hdr* yaffsObjectHeader, int fileOffset, bool headerLoaded) {
     if (yaffsObjectId == YAFFS_OBJECTID_ROOT) {
-        mYaffsRoot = new YaffsItem(NULL, yaffsObjectHeader, fileOffset, yaffsObjectId);
-        mYaffsObjectsItemMap.insert(YAFFS_OBJECTID_ROOT, mYaffsRoot);
+        int objectRow = mObjectTable.append(yaffsObjectId, fileOffset, *yaffsObjectHeader, headerLoaded);
+        mYaffsRoot = new YaffsItem(NULL, &mObjectTable, objectRow);
         return;
     }
 
-    //get childs parent
-    YaffsItem* parent = mYaffsObjectsItemMap.value(yaffsObjectHeader->parent_obj_id);
+    //items are only created when their directory is expanded, until then the object waits in the table
+    int objectRow = mRowsByObjectId.value(yaffsObjectId, -1);
+    if (objectRow != -1) {
+        QVector<int>& siblingRows = mChildRows[mObjectTable.getParentObjectId(objectRow)];
+        int position = siblingRows.indexOf(objectRow);
+        if (position != -1) {
+            siblingRows.remove(position);
+        }
+        if (!mObjectTable.isHeaderLoaded(objectRow)) {
+            mItemsWithoutHeader--;
+        }
+    }
 
-    //create item and map it
-    YaffsItem* child = new YaffsItem(parent, yaffsObjectHeader, fileOffset, yaffsObjectId);
-    mYaffsObjectsItemMap.insert(yaffsObjectId, child);
+    objectRow = mObjectTable.append(yaffsObjectId, fileOffset, *yaffsObjectHeader, headerLoaded);
+    mRowsByObjectId.insert(yaffsObjectId, objectRow);
+    mChildRows[yaffsObjectHeader->parent_obj_id].append(objectRow);
 
-    if (parent) {
-        //add child to parent
-        parent->appendChild(child);
-    } else {
-        qDebug() << "error, parent not found, id: " << yaffsObjectHeader->parent_obj_id;
-        mYaffsObjectsWithoutParent.append(child);
+    if (!headerLoaded) {
+        mItemsWithoutHeader++;
     }
 }
 
 void YaffsModel::readComplete() {
     //if image didn't contain a root but did contain other stuff, give model a root
-    if (mYaffsRoot == NULL && mYaffsObjectsItemMap.size() > 0) {
-        mYaffsRoot = YaffsItem::createRoot();
-        mYaffsObjectsItemMap.insert(YAFFS_OBJECTID_ROOT, mYaffsRoot);
-    }
-
-    if (mYaffsObjectsWithoutParent.size() > 0) {
-        //child objects might have been before parent
-        foreach (YaffsItem* child, mYaffsObjectsWithoutParent) {
-            YaffsItem* parent = mYaffsObjectsItemMap.value(child->getHeader().parent_obj_id);
-            if (parent) {
-                parent->appendChild(child);
-                qDebug() << "child came before parent in file, parent id: " << child->getHeader().parent_obj_id;
-            } else {
-                qDebug() << "parent still not found, item name: " << child->getName();
+    if (mYaffsRoot == NULL && mObjectTable.size() > 0) {
+        mYaffsRoot = YaffsItem::createRoot(&mObjectTable);
+    }
+
+    QHash<int, QVector<int> >::const_iterator i;
+    for (i = mChildRows.constBegin(); i != mChildRows.constEnd(); ++i) {
+        if (i.key() != YAFFS_OBJECTID_ROOT && !mRowsByObjectId.contains(i.key())) {
+            qDebug() << "error, parent not found, id: " << i.key() << ", children: " << i.value().size();
+        }
+    }
+    //hard links are shown with the size of the file they share data with, and read through it
+    QHash<int, int>::const_iterator r;
+    for (r = mRowsByObjectId.constBegin(); r != mRowsByObjectId.constEnd(); ++r) {
+        int objectRow = r.value();
+        if (mObjectTable.getType(objectRow) == YAFFS_OBJECT_TYPE_HARDLINK) {
+            int targetRow = mRowsByObjectId.value(mObjectTable.getEquivalentObjectId(objectRow), -1);
+            if (targetRow != -1 && mObjectTable.getType(targetRow) == YAFFS_OBJECT_TYPE_FILE) {
+                mHardLinkTargets.insert(objectRow, targetRow);
+                mObjectTable.setFileSize(objectRow, mObjectTable.getFileSize(targetRow));
             }
         }
     }
-    mYaffsObjectsWithoutParent.clear();
+    mRowsByObjectId.clear();
 }
@@ -21,11 +21,18 @@
 
 #include <QAbstractItemModel>
 #include <QModelIndex>
-#include <QMap>
+#include <QPersistentModelIndex>
+#include <QHash>
+#include <QSet>
 
 #include "YaffsControl.h"
+#include "YaffsWriter.h"
+#include "YaffsImporter.h"
 #include "YaffsItem.h"
 
+//collapsing a directory gives its child items back to the object table once this many items exist
+#define MAX_ITEMS_BEFORE_RELEASE    50000
+
 class YaffsModel : public QAbstractItemModel,
                    public YaffsControlObserver {
     Q_OBJECT
@@ -36,13 +43,26 @@ public:
 
     void newImage(const QString& newImageName);
     YaffsReadInfo openImage(const QString& imageFilename);
+    void setVerifyTags(bool verifyTags) { mVerifyTags = verifyTags; }
+    void setOobLayout(int oobLayout) { mOobLayout = oobLayout; }        //of the image about to be opened
+    int getOobLayout() const { return mOobLayout; }
     void importFile(YaffsItem* parentItem, const QString& filenameWithPath);
-    void importDirectory(YaffsItem* parentItem, const QString& directoryName);
+    bool importDirectory(YaffsItem* parentItem, const QString& directoryName);      //read in the background, see importFinished()
+    bool isImporting() const { return (mImporter != NULL); }
+    void fetchAll(YaffsItem* dirItem);
+    void releaseChildItems(const QModelIndex& dirIndex);
     bool save();
-    YaffsSaveInfo saveAs(const QString& filename);
+    YaffsSaveInfo saveAs(const QString& filename, int oobLayout);
+    void setSaveThreads(int saveThreads) { mSaveThreads = saveThreads; }      //1 writes the image in order on this thread
+    void setDeduplicate(bool deduplicate) { mDeduplicate = deduplicate; }    //saving writes identical new files as hard links
     QString getImageFilename() const { return mImageFilename; }
-    bool isDirty() const { return (mItemsDirty + mItemsDeleted + mItemsNew); }
+    const YaffsChunkMap& getChunkMap() const { return mChunkMap; }
+    int getDataHeaderPosition(const YaffsItem* item) const;
+    bool isDirty() const { return (mDirtyItems.size() + mItemsDeleted + mItemsNew); }
     bool isImageOpen() const { return (mYaffsRoot != NULL); }
+    void beginTransaction();
+    void commitTransaction();
+    bool isNewImage() const { return (mYaffsRoot && mYaffsRoot->getCondition() == YaffsItem::NEW); }      //never saved
 
     //from QAbstractItemModel
     QVariant data(const QModelIndex& itemIndex, int role) const;
@@ -52,18 +72,51 @@ public:
     QModelIndex index(int row, int column, const QModelIndex& parentIndex = QModelIndex()) const;
     QModelIndex parent(const QModelIndex& itemIndex) const;
     int rowCount(const QModelIndex& parentIndex = QModelIndex()) const;
+    bool hasChildren(const QModelIndex& parentIndex = QModelIndex()) const;
     int columnCount(const QModelIndex& parentIndex = QModelIndex()) const;
     int removeRows(const QModelIndexList& selectedRows);
+    bool canFetchMore(const QModelIndex& parentIndex) const;
+    void fetchMore(const QModelIndex& parentIndex);
+
+public slots:
+    void cancelImport();
+
+signals:
+    void importProgress(int itemsFound);
+    void importFinished(int itemsImported);          //0 if the import was cancelled
+
+private slots:
+    void on_importer_finished();
 
 protected:
     //from YaffsControlObserver
-    void newItem(int yaffsObjectId, const yaffs_obj_hdr* yaffsObjectHeader, int fileOffset);
+    void newItem(int yaffsObjectId, const yaffs_obj_hdr* yaffsObjectHeader, int fileOffset, bool headerLoaded);
     void readComplete();
 
 private:
+    void createChildItems(YaffsItem* dirItem, bool recursive);
+    void storeItem(const YaffsItem* item);
+    bool isSubtreeClean(const YaffsItem* item) const;
+    void discardObjects(YaffsItem* item);
+    void discardChildRows(int objectId);
+    YaffsControl* getHeaderControl();
+    void closeHeaderControl();
+    void loadHeaders(YaffsItem* dirItem, bool recursive);
+    void loadHeaders(YaffsControl& yaffsControl, YaffsItem* dirItem, bool recursive);
+    bool saveHeaders();
+    bool saveIncremental();
+    void saveChanges(YaffsItem* item);
     void saveDirectory(YaffsItem* dirItem);
     void saveFile(YaffsItem* dirItem);
+    void writeFile(YaffsItem* fileItem);
     void saveSymLink(YaffsItem* dirItem);
+    void saveHardLinks();
+    void findDuplicates(bool newFilesOnly);
+    YaffsItem* createImportedItems(YaffsItem* parentItem, const YaffsImportEntry* entry, int& itemsCreated);
+    void insertItem(YaffsItem* parentItem, YaffsItem* item);
+    void itemChanged(YaffsItem* item, const QModelIndex& itemIndex);
+    void emitPendingChanges();
+    void collectFiles(YaffsItem* dirItem, QList<YaffsItem*>& files);
     int processChildItemsForDelete(YaffsItem* item);
     int calculateAndDeleteContiguousRows(QList<int>& rows, YaffsItem* parentItem);
     int deleteRows(int row, int count, const QModelIndex& parentIndex);
@@ -71,12 +124,35 @@ private:
 private:
     QString mImageFilename;
     YaffsItem* mYaffsRoot;
-    QMap<int, YaffsItem*> mYaffsObjectsItemMap;
-    QList<YaffsItem*> mYaffsObjectsWithoutParent;
+    YaffsObjectTable mObjectTable;
+    YaffsChunkMap mChunkMap;
+    QHash<int, QVector<int> > mChildRows;           //object table rows without an item, by parent object id
+    QHash<int, int> mRowsByObjectId;                //only while reading an image
+    YaffsControl* mHeaderControl;                   //read-only, for the headers a tags-only scan left out, until the image changes
     YaffsControl* mYaffsSaveControl;
+    YaffsControl* mYaffsSourceControl;              //the image being saved from, while saving with mYaffsSaveControl
+    YaffsWriter* mYaffsWriter;                      //used instead of mYaffsSaveControl when saving on several threads
+    int mSaveThreads;
+    bool mDeduplicate;
+    QHash<int, int> mHardLinkTargets;               //object table row of the file each hard link shares data with, by row of the link
+    QHash<int, int> mDuplicateOf;                   //while saving, row of the file each duplicate becomes a hard link to
+    QHash<int, int> mSavedObjectIds;                //while saving, new object id of each file written, by row
+    QList<YaffsItem*> mPendingHardLinks;            //while saving, written once every file has its new object id
+    YaffsImporter* mImporter;                       //while a directory is being imported, owned
+    QPersistentModelIndex mImportParent;            //the directory it is imported into, invalid once it has been removed
+    int mTransactionDepth;
+    QList<YaffsItem*> mPendingParents;              //during a transaction, directories given new rows, in the order they were first given one
+    QHash<YaffsItem*, QList<YaffsItem*> > mPendingInserts;     //during a transaction, new items not yet in their directory
+    QHash<YaffsItem*, QSet<YaffsItem*> > mPendingRemovals;     //during a transaction, items still in their directory until the commit
+    QSet<YaffsItem*> mChangedItems;                 //during a transaction, items changed by setData()
+    bool mVerifyTags;
+    int mOobLayout;                                 //see YaffsControl::getOobLayout()
     int mItemsNew;
-    int mItemsDirty;
+    QSet<YaffsItem*> mDirtyItems;                   //clean items whose header has been edited since the last save
+    QVector<int> mDeletedRows;                      //object table rows of deleted objects that are still in the image
     int mItemsDeleted;
+    int mItemsWithoutHeader;
+    int mItemsCreated;
 };
 
 #endif  //YAFFSMODEL_H
@@ -0,0 +1,230 @@
+/*
+ * yaffey: Utility for reading, editing and writing YAFFS2 images
+ * Copyright (C) 2012 David Place <david.t.place@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "YaffsObjectTable.h"
+
+#define MIN_STRING_SLOTS    1024
+
+YaffsObjectTable::YaffsObjectTable() {
+    clear();
+}
+
+int YaffsObjectTable::append(int objectId, int headerPosition, const yaffs_obj_hdr& objectHeader, bool headerLoaded) {
+    int row = mObjectIds.size();
+
+    mObjectIds.append(objectId);
+    mHeaderPositions.append(headerPosition);
+    mParentObjectIds.append(0);
+    mModes.append(0);
+    mUserIds.append(0);
+    mGroupIds.append(0);
+    mAccessTimes.append(0);
+    mModifyTimes.append(0);
+    mChangeTimes.append(0);
+    mFileSizes.append(0);
+    mNameOffsets.append(0);
+    mAliasOffsets.append(0);
+    mExtraIndices.append(0);
+    mTypes.append(0);
+    mHeaderLoaded.append(false);
+
+    setHeader(row, objectHeader);
+    mHeaderLoaded[row] = headerLoaded;
+
+    return row;
+}
+
+void YaffsObjectTable::clear() {
+    mObjectIds.clear();
+    mHeaderPositions.clear();
+    mParentObjectIds.clear();
+    mModes.clear();
+    mUserIds.clear();
+    mGroupIds.clear();
+    mAccessTimes.clear();
+    mModifyTimes.clear();
+    mChangeTimes.clear();
+    mFileSizes.clear();
+    mNameOffsets.clear();
+    mAliasOffsets.clear();
+    mExtraIndices.clear();
+    mTypes.clear();
+    mHeaderLoaded.clear();
+
+    mStrings = QByteArray(1, '\0');
+    mStringSlots.fill(-1, MIN_STRING_SLOTS);
+    mStringCount = 0;
+    mExtras.clear();
+    mExtraIndexByContent.clear();
+}
+
+int YaffsObjectTable::memoryUsage() const {
+    int usage = sizeof(YaffsObjectTable);
+    usage += mObjectIds.capacity() * sizeof(qint32) * 3;        //ids, header positions, parent ids
+    usage += mModes.capacity() * sizeof(u32) * 7;               //mode, uid, gid, times, file size
+    usage += mNameOffsets.capacity() * sizeof(qint32) * 3;      //name, alias and extra indices
+    usage += mTypes.capacity() * (sizeof(u8) + sizeof(bool));
+    usage += mStrings.capacity();
+    usage += mStringSlots.capacity() * sizeof(qint32);
+    usage += mExtras.capacity() * (sizeof(Extra) * 2 + sizeof(int));
+    return usage;
+}
+
+void YaffsObjectTable::getHeader(int row, yaffs_obj_hdr& objectHeader) const {
+    const Extra& extra = mExtras.at(mExtraIndices.at(row));
+
+    memset(&objectHeader, 0xff, sizeof(yaffs_obj_hdr));
+    memset(objectHeader.name, 0, YAFFS_MAX_NAME_LENGTH);
+    memset(objectHeader.alias, 0, YAFFS_MAX_ALIAS_LENGTH);
+    memcpy(objectHeader.name, getName(row), qstrlen(getName(row)));
+    memcpy(objectHeader.alias, getAlias(row), qstrlen(getAlias(row)));
+    objectHeader.name[YAFFS_MAX_NAME_LENGTH] = extra.nameTail;
+    objectHeader.alias[YAFFS_MAX_ALIAS_LENGTH] = extra.aliasTail;
+
+    objectHeader.type = getType(row);
+    objectHeader.parent_obj_id = mParentObjectIds.at(row);
+    objectHeader.sum_no_longer_used = extra.checksum;
+    objectHeader.yst_mode = mModes.at(row);
+    objectHeader.yst_uid = mUserIds.at(row);
+    objectHeader.yst_gid = mGroupIds.at(row);
+    objectHeader.yst_atime = mAccessTimes.at(row);
+    objectHeader.yst_mtime = mModifyTimes.at(row);
+    objectHeader.yst_ctime = mChangeTimes.at(row);
+    objectHeader.file_size_low = mFileSizes.at(row);
+    objectHeader.equiv_id = extra.equivId;
+    objectHeader.yst_rdev = extra.rdev;
+    memcpy(objectHeader.win_ctime, &extra.winTimes[0], sizeof(objectHeader.win_ctime));
+    memcpy(objectHeader.win_atime, &extra.winTimes[2], sizeof(objectHeader.win_atime));
+    memcpy(objectHeader.win_mtime, &extra.winTimes[4], sizeof(objectHeader.win_mtime));
+    objectHeader.inband_shadowed_obj_id = extra.inbandShadowedObjectId;
+    objectHeader.inband_is_shrink = extra.inbandIsShrink;
+    objectHeader.file_size_high = extra.fileSizeHigh;
+    objectHeader.reserved[0] = extra.reserved;
+    objectHeader.shadows_obj = extra.shadowsObject;
+    objectHeader.is_shrink = extra.isShrink;
+}
+
+void YaffsObjectTable::setHeader(int row, const yaffs_obj_hdr& objectHeader) {
+    mTypes[row] = objectHeader.type;
+    mParentObjectIds[row] = objectHeader.parent_obj_id;
+    mModes[row] = objectHeader.yst_mode;
+    mUserIds[row] = objectHeader.yst_uid;
+    mGroupIds[row] = objectHeader.yst_gid;
+    mAccessTimes[row] = objectHeader.yst_atime;
+    mModifyTimes[row] = objectHeader.yst_mtime;
+    mChangeTimes[row] = objectHeader.yst_ctime;
+    mFileSizes[row] = objectHeader.file_size_low;
+    mNameOffsets[row] = internString(objectHeader.name, qstrnlen(objectHeader.name, YAFFS_MAX_NAME_LENGTH));
+    mAliasOffsets[row] = internString(objectHeader.alias, qstrnlen(objectHeader.alias, YAFFS_MAX_ALIAS_LENGTH));
+    mExtraIndices[row] = internExtra(objectHeader);
+    mHeaderLoaded[row] = true;
+}
+
+void YaffsObjectTable::setName(int row, const char* name) {
+    mNameOffsets[row] = internString(name, qstrnlen(name, YAFFS_MAX_NAME_LENGTH));
+}
+
+void YaffsObjectTable::setAlias(int row, const char* alias) {
+    mAliasOffsets[row] = internString(alias, qstrnlen(alias, YAFFS_MAX_ALIAS_LENGTH));
+}
+
+int YaffsObjectTable::internString(const char* string, int length) {
+    if (length == 0) {
+        return 0;
+    }
+
+    if ((mStringCount + 1) * 2 > mStringSlots.size()) {
+        growStringSlots();
+    }
+
+    uint mask = mStringSlots.size() - 1;
+    uint slot = hashString(string, length) & mask;
+    while (mStringSlots.at(slot) != -1) {
+        int offset = mStringSlots.at(slot);
+        if (qstrncmp(mStrings.constData() + offset, string, length) == 0 && mStrings.at(offset + length) == '\0') {
+            return offset;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    int offset = mStrings.size();
+    mStrings.append(string, length);
+    mStrings.append('\0');
+    mStringSlots[slot] = offset;
+    mStringCount++;
+
+    return offset;
+}
+
+int YaffsObjectTable::internExtra(const yaffs_obj_hdr& objectHeader) {
+    Extra extra;
+    memset(&extra, 0, sizeof(Extra));
+    extra.equivId = objectHeader.equiv_id;
+    extra.rdev = objectHeader.yst_rdev;
+    memcpy(&extra.winTimes[0], objectHeader.win_ctime, sizeof(objectHeader.win_ctime));
+    memcpy(&extra.winTimes[2], objectHeader.win_atime, sizeof(objectHeader.win_atime));
+    memcpy(&extra.winTimes[4], objectHeader.win_mtime, sizeof(objectHeader.win_mtime));
+    extra.inbandShadowedObjectId = objectHeader.inband_shadowed_obj_id;
+    extra.inbandIsShrink = objectHeader.inband_is_shrink;
+    extra.fileSizeHigh = objectHeader.file_size_high;
+    extra.reserved = objectHeader.reserved[0];
+    extra.shadowsObject = objectHeader.shadows_obj;
+    extra.isShrink = objectHeader.is_shrink;
+    extra.checksum = objectHeader.sum_no_longer_used;
+    extra.nameTail = objectHeader.name[YAFFS_MAX_NAME_LENGTH];
+    extra.aliasTail = objectHeader.alias[YAFFS_MAX_ALIAS_LENGTH];
+
+    QByteArray content(reinterpret_cast<const char*>(&extra), sizeof(Extra));
+    QHash<QByteArray, int>::const_iterator i = mExtraIndexByContent.constFind(content);
+    if (i != mExtraIndexByContent.constEnd()) {
+        return i.value();
+    }
+
+    int index = mExtras.size();
+    mExtras.append(extra);
+    mExtraIndexByContent.insert(content, index);
+    return index;
+}
+
+void YaffsObjectTable::growStringSlots() {
+    QVector<qint32> newSlots(qMax(mStringSlots.size() * 2, MIN_STRING_SLOTS), -1);
+    uint mask = newSlots.size() - 1;
+
+    foreach (qint32 offset, mStringSlots) {
+        if (offset != -1) {
+            const char* string = mStrings.constData() + offset;
+            uint slot = hashString(string, qstrlen(string)) & mask;
+            while (newSlots.at(slot) != -1) {
+                slot = (slot + 1) & mask;
+            }
+            newSlots[slot] = offset;
+        }
+    }
+
+    mStringSlots = newSlots;
+}
+
+//FNV-1a
+uint YaffsObjectTable::hashString(const char* string, int length) {
+    uint hash = 2166136261u;
+    for (int i = 0; i < length; ++i) {
+        hash ^= static_cast<u8>(string[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
@@ -0,0 +1,116 @@
+/*
+ * yaffey: Utility for reading, editing and writing YAFFS2 images
+ * Copyright (C) 2012 David Place <david.t.place@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef YAFFSOBJECTTABLE_H
+#define YAFFSOBJECTTABLE_H
+
+#include <QVector>
+#include <QByteArray>
+#include <QHash>
+
+#include "Yaffs2.h"
+
+//Holds the header fields of every object in columns instead of one yaffs_obj_hdr per object.
+//Names and aliases are interned in a single string arena, and the fields that hardly ever
+//differ between objects are shared blocks. A full header is only rebuilt when one is written.
+class YaffsObjectTable {
+public:
+    YaffsObjectTable();
+
+    int append(int objectId, int headerPosition, const yaffs_obj_hdr& objectHeader, bool headerLoaded);
+    void clear();
+    int size() const { return mObjectIds.size(); }
+    int memoryUsage() const;
+
+    void getHeader(int row, yaffs_obj_hdr& objectHeader) const;
+    void setHeader(int row, const yaffs_obj_hdr& objectHeader);
+
+    int getObjectId(int row) const { return mObjectIds.at(row); }
+    int getHeaderPosition(int row) const { return mHeaderPositions.at(row); }
+    bool isHeaderLoaded(int row) const { return mHeaderLoaded.at(row); }
+    yaffs_obj_type getType(int row) const { return static_cast<yaffs_obj_type>(mTypes.at(row)); }
+    int getParentObjectId(int row) const { return mParentObjectIds.at(row); }
+    const char* getName(int row) const { return mStrings.constData() + mNameOffsets.at(row); }
+    const char* getAlias(int row) const { return mStrings.constData() + mAliasOffsets.at(row); }
+    u32 getMode(int row) const { return mModes.at(row); }
+    u32 getUserId(int row) const { return mUserIds.at(row); }
+    u32 getGroupId(int row) const { return mGroupIds.at(row); }
+    u32 getAccessTime(int row) const { return mAccessTimes.at(row); }
+    u32 getModifyTime(int row) const { return mModifyTimes.at(row); }
+    u32 getChangeTime(int row) const { return mChangeTimes.at(row); }
+    u32 getFileSize(int row) const { return mFileSizes.at(row); }
+    int getEquivalentObjectId(int row) const { return mExtras.at(mExtraIndices.at(row)).equivId; }
+
+    void setObjectId(int row, int objectId) { mObjectIds[row] = objectId; }
+    void setHeaderPosition(int row, int headerPosition) { mHeaderPositions[row] = headerPosition; }
+    void setHeaderLoaded(int row, bool loaded) { mHeaderLoaded[row] = loaded; }
+    void setParentObjectId(int row, int parentObjectId) { mParentObjectIds[row] = parentObjectId; }
+    void setName(int row, const char* name);
+    void setAlias(int row, const char* alias);
+    void setMode(int row, u32 mode) { mModes[row] = mode; }
+    void setUserId(int row, u32 uid) { mUserIds[row] = uid; }
+    void setGroupId(int row, u32 gid) { mGroupIds[row] = gid; }
+    void setFileSize(int row, u32 fileSize) { mFileSizes[row] = fileSize; }
+
+private:
+    //header fields that are nearly always the same for every object in an image
+    struct Extra {
+        qint32 equivId;
+        u32 rdev;
+        u32 winTimes[6];
+        u32 inbandShadowedObjectId;
+        u32 inbandIsShrink;
+        u32 fileSizeHigh;
+        u32 reserved;
+        qint32 shadowsObject;
+        u32 isShrink;
+        u16 checksum;
+        u8 nameTail;        //last byte of the name and alias buffers
+        u8 aliasTail;
+    };
+
+    int internString(const char* string, int length);
+    int internExtra(const yaffs_obj_hdr& objectHeader);
+    void growStringSlots();
+    static uint hashString(const char* string, int length);
+
+private:
+    QVector<qint32> mObjectIds;
+    QVector<qint32> mHeaderPositions;
+    QVector<qint32> mParentObjectIds;
+    QVector<u32> mModes;
+    QVector<u32> mUserIds;
+    QVector<u32> mGroupIds;
+    QVector<u32> mAccessTimes;
+    QVector<u32> mModifyTimes;
+    QVector<u32> mChangeTimes;
+    QVector<u32> mFileSizes;
+    QVector<qint32> mNameOffsets;
+    QVector<qint32> mAliasOffsets;
+    QVector<qint32> mExtraIndices;
+    QVector<u8> mTypes;
+    QVector<bool> mHeaderLoaded;
+
+    QByteArray mStrings;                    //NUL terminated strings, offset 0 is the empty string
+    QVector<qint32> mStringSlots;           //open addressing hash of string offsets, -1 if free
+    int mStringCount;
+    QVector<Extra> mExtras;
+    QHash<QByteArray, int> mExtraIndexByContent;
+};
+
+#endif  //YAFFSOBJECTTABLE_H
@@ -0,0 +1,237 @@
+/*
+ * yaffey: Utility for reading, editing and writing YAFFS2 images
+ * Copyright (C) 2012 David Place <david.t.place@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <QFile>
+#include <QFileInfo>
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#endif  //Q_OS_UNIX
+
+#include "YaffsWriter.h"
+
+//pages each worker is given, large files are split between several workers
+#define WRITE_TASK_PAGES        (4 * PAGES_PER_BLOCK)
+
+//pages a worker assembles before writing them out together
+#define WRITE_BATCH_PAGES       PAGES_PER_BLOCK
+
+//writes one range of pages
+class YaffsWriter::WriteTask : public QRunnable {
+public:
+    WriteTask(YaffsWriter& writer, int firstObject, long firstPage, long endPage) :
+        mYaffsWriter(writer), mFirstObject(firstObject), mFirstPage(firstPage), mEndPage(endPage) {
+    }
+
+    void run() {
+        if (!mYaffsWriter.writePages(mFirstObject, mFirstPage, mEndPage)) {
+            QMutexLocker locker(&mYaffsWriter.mResultMutex);
+            mYaffsWriter.mWriteFailed = true;
+        }
+    }
+
+private:
+    YaffsWriter& mYaffsWriter;
+    int mFirstObject;
+    long mFirstPage;
+    long mEndPage;
+};
+
+YaffsWriter::YaffsWriter(const QString& imageFilename, const QString& sourceImageFilename, const YaffsChunkMap& sourceChunkMap, int sourceOobLayout) :
+    mImage(imageFilename.toStdString().c_str(), NULL),
+    mSourceImage(sourceImageFilename.toStdString().c_str(), NULL) {
+    mSourceImage.setChunkMap(sourceChunkMap);
+    mSourceImage.setOobLayout(sourceOobLayout);
+    mSourceOpen = false;
+    mOobLayout = &YaffsControl::getOobLayout(0);
+    mNumPages = 0;
+    mObjectId = YAFFS_NOBJECT_BUCKETS + 1;
+    memset(&mSaveInfo, 0, sizeof(YaffsSaveInfo));
+    mWriteFailed = false;
+}
+
+bool YaffsWriter::open() {
+    //a new image has no source, all of its files come from outside
+    mSourceOpen = mSourceImage.open(YaffsControl::OPEN_READ);
+    return mImage.open(YaffsControl::OPEN_NEW);
+}
+
+void YaffsWriter::setOobLayout(int oobLayout) {
+    mOobLayout = &YaffsControl::getOobLayout(oobLayout);
+}
+
+int YaffsWriter::addRoot(const yaffs_obj_hdr& objectHeader, int& headerPos) {
+    addObject(objectHeader, YAFFS_OBJECTID_ROOT, 0, headerPos);
+    mSaveInfo.numDirsSaved++;
+    return YAFFS_OBJECTID_ROOT;
+}
+
+int YaffsWriter::addDirectory(const yaffs_obj_hdr& objectHeader, int& headerPos) {
+    int objectId = mObjectId++;
+    addObject(objectHeader, objectId, 0, headerPos);
+    mSaveInfo.numDirsSaved++;
+    return objectId;
+}
+
+int YaffsWriter::addSymLink(const yaffs_obj_hdr& objectHeader, int& headerPos) {
+    int objectId = mObjectId++;
+    addObject(objectHeader, objectId, 0, headerPos);
+    mSaveInfo.numSymLinksSaved++;
+    return objectId;
+}
+
+int YaffsWriter::addHardLink(const yaffs_obj_hdr& objectHeader, int& headerPos) {
+    int objectId = mObjectId++;
+    addObject(objectHeader, objectId, 0, headerPos);
+    mSaveInfo.numHardLinksSaved++;
+    return objectId;
+}
+
+int YaffsWriter::addFile(const yaffs_obj_hdr& objectHeader, int& headerPos, const QString& externalFilename, int fileSize) {
+    QFileInfo fileInfo(externalFilename);
+    if (!fileInfo.isReadable() || fileInfo.size() < fileSize) {
+        return -1;
+    }
+
+    int objectId = mObjectId++;
+    Object& object = addObject(objectHeader, objectId, fileSize, headerPos);
+    object.externalFilename = externalFilename;
+    mSaveInfo.numFilesSaved++;
+    return objectId;
+}
+
+int YaffsWriter::addFile(const yaffs_obj_hdr& objectHeader, int& headerPos, int sourceHeaderPos, int fileSize) {
+    //as in a serial save, empty files in the source image aren't copied
+    YaffsFile sourceFile;
+    if (!mSourceOpen || !mSourceImage.findFile(sourceHeaderPos, sourceFile) ||
+        sourceFile.size <= 0 || sourceFile.size < fileSize) {
+        return -1;
+    }
+
+    int objectId = mObjectId++;
+    Object& object = addObject(objectHeader, objectId, fileSize, headerPos);
+    object.sourceFile = sourceFile;
+    mSaveInfo.numFilesSaved++;
+    return objectId;
+}
+
+YaffsWriter::Object& YaffsWriter::addObject(const yaffs_obj_hdr& objectHeader, u32 objectId, long fileSize, int& headerPos) {
+    Object object;
+    object.header = objectHeader;
+    object.objectId = objectId;
+    object.firstPage = mNumPages;
+    object.numPages = 1 + (fileSize + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    object.fileSize = fileSize;
+    object.sourceFile.headerPos = -1;
+    mObjects.append(object);
+
+    //the same chunks YaffsControl::writePage() records
+    for (long chunkId = 0; chunkId < object.numPages; ++chunkId) {
+        mChunkMap.addChunk(objectId, chunkId, mNumPages + chunkId, YAFFS_LOWEST_SEQUENCE_NUMBER);
+    }
+
+    headerPos = mNumPages * PAGE_SIZE;
+    mNumPages += object.numPages;
+    return mObjects.last();
+}
+
+bool YaffsWriter::write(int numThreads) {
+    QThreadPool pool;
+    pool.setMaxThreadCount(numThreads > 0 ? numThreads : QThread::idealThreadCount());
+
+    long taskFirstPage = 0;
+    int taskFirstObject = 0;
+    for (int i = 0; i < mObjects.size(); ++i) {
+        const Object& object = mObjects.at(i);
+        long endPage = object.firstPage + object.numPages;
+        while (endPage - taskFirstPage >= WRITE_TASK_PAGES) {
+            long taskEndPage = taskFirstPage + WRITE_TASK_PAGES;
+            pool.start(new WriteTask(*this, taskFirstObject, taskFirstPage, taskEndPage));
+            taskFirstPage = taskEndPage;
+            taskFirstObject = i;
+        }
+    }
+    if (taskFirstPage < mNumPages) {
+        pool.start(new WriteTask(*this, taskFirstObject, taskFirstPage, mNumPages));
+    }
+    pool.waitForDone();
+
+    return !mWriteFailed;
+}
+
+//fills pages firstPage to endPage - 1, which start in object firstObject, and writes them in batches
+bool YaffsWriter::writePages(int firstObject, long firstPage, long endPage) const {
+    u8* buffer = static_cast<u8*>(qMallocAligned(WRITE_BATCH_PAGES * PAGE_SIZE, WRITE_BUFFER_ALIGNMENT));
+    QFile externalFile;
+    int externalObject = -1;
+    int objectIndex = firstObject;
+
+    bool result = true;
+    long page = firstPage;
+    while (result && page < endPage) {
+        int batchPages = qMin<long>(WRITE_BATCH_PAGES, endPage - page);
+        for (int i = 0; result && i < batchPages; ++i) {
+            while (page + i >= mObjects.at(objectIndex).firstPage + mObjects.at(objectIndex).numPages) {
+                objectIndex++;
+            }
+
+            const Object& object = mObjects.at(objectIndex);
+            u8* pageData = buffer + i * PAGE_SIZE;
+            u32 chunkId = page + i - object.firstPage;
+            if (chunkId == 0) {
+                YaffsControl::packHeaderPage(pageData, object.header, object.objectId, *mOobLayout);
+            } else {
+                long offset = (chunkId - 1) * CHUNK_SIZE;
+                long numBytes = qMin<long>(CHUNK_SIZE, object.fileSize - offset);
+                if (object.sourceFile.headerPos != -1) {
+                    //the chunk goes across as it is and only the tags change, unless it was never written
+                    if (mSourceImage.copyDataPage(object.sourceFile, chunkId, pageData, object.objectId, numBytes, *mOobLayout)) {
+                        continue;
+                    }
+                    result = (mSourceImage.readRange(object.sourceFile, offset, reinterpret_cast<char*>(pageData), numBytes) == numBytes);
+                } else {
+                    if (externalObject != objectIndex) {
+                        externalFile.close();
+                        externalFile.setFileName(object.externalFilename);
+                        externalObject = objectIndex;
+                        result = externalFile.open(QIODevice::ReadOnly);
+#ifdef Q_OS_UNIX
+                        if (result) {
+                            posix_fadvise(externalFile.handle(), 0, 0, POSIX_FADV_SEQUENTIAL);
+                        }
+#endif  //Q_OS_UNIX
+                    }
+                    result = (result && externalFile.seek(offset) &&
+                              externalFile.read(reinterpret_cast<char*>(pageData), numBytes) == numBytes);
+                }
+                YaffsControl::packDataPage(pageData, object.objectId, chunkId, numBytes, *mOobLayout);
+            }
+        }
+
+        if (result) {
+            result = mImage.writePagesAt(page, buffer, batchPages);
+        }
+        page += batchPages;
+    }
+
+    qFreeAligned(buffer);
+    return result;
+}
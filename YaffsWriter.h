@@ -0,0 +1,80 @@
+/*
+ * yaffey: Utility for reading, editing and writing YAFFS2 images
+ * Copyright (C) 2012 David Place <david.t.place@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef YAFFSWRITER_H
+#define YAFFSWRITER_H
+
+#include <QString>
+#include <QVector>
+#include <QMutex>
+
+#include "YaffsControl.h"
+
+//Writes a new image from a page layout planned before any data is read.
+//Objects are added in the order YaffsControl would write them and get the same object ids and header
+//positions, then write() fills and writes disjoint page ranges on several threads. The image is identical.
+class YaffsWriter {
+public:
+    YaffsWriter(const QString& imageFilename, const QString& sourceImageFilename, const YaffsChunkMap& sourceChunkMap, int sourceOobLayout);
+
+    bool open();
+    void setOobLayout(int oobLayout);
+    int addRoot(const yaffs_obj_hdr& objectHeader, int& headerPos);
+    int addDirectory(const yaffs_obj_hdr& objectHeader, int& headerPos);
+    int addSymLink(const yaffs_obj_hdr& objectHeader, int& headerPos);
+    int addHardLink(const yaffs_obj_hdr& objectHeader, int& headerPos);
+
+    //return -1 and add nothing if the data can't be read
+    int addFile(const yaffs_obj_hdr& objectHeader, int& headerPos, const QString& externalFilename, int fileSize);
+    int addFile(const yaffs_obj_hdr& objectHeader, int& headerPos, int sourceHeaderPos, int fileSize);
+
+    bool write(int numThreads);
+    YaffsSaveInfo getSaveInfo() { return mSaveInfo; }
+    const YaffsChunkMap& getChunkMap() const { return mChunkMap; }
+
+private:
+    struct Object {
+        yaffs_obj_hdr header;
+        u32 objectId;
+        long firstPage;
+        long numPages;
+        long fileSize;
+        QString externalFilename;   //for files from outside the image
+        YaffsFile sourceFile;       //for files from the source image, headerPos is -1 otherwise
+    };
+
+    class WriteTask;
+
+    Object& addObject(const yaffs_obj_hdr& objectHeader, u32 objectId, long fileSize, int& headerPos);
+    bool writePages(int firstObject, long firstPage, long endPage) const;
+
+private:
+    YaffsControl mImage;
+    YaffsControl mSourceImage;
+    bool mSourceOpen;
+    const YaffsOobLayout* mOobLayout;
+    QVector<Object> mObjects;       //in page order
+    long mNumPages;
+    int mObjectId;
+    YaffsSaveInfo mSaveInfo;
+    YaffsChunkMap mChunkMap;
+    QMutex mResultMutex;
+    bool mWriteFailed;
+};
+
+#endif  //YAFFSWRITER_H
@@ -20,12 +20,19 @@
 
 #include "MainWindow.h"
 
+extern "C" {
+    #include "yaffs2/yaffs_hweight.h"
+}
+
 int main(int argc, char* argv[]) {
     QString arg;
     if (argc > 0) {
         arg = argv[1];
     }
 
+    //before any scan or save threads use it
+    yaffs_hweight_init();
+
     QApplication a(argc, argv);
     MainWindow w(NULL, arg);
     w.show();
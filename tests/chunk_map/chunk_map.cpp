@@ -0,0 +1,113 @@
+/*
+ * yaffey: Utility for reading, editing and writing YAFFS2 images
+ * Copyright (C) 2012 David Place <david.t.place@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <stdio.h>
+
+#include "YaffsChunkMap.h"
+
+//exits with 1 if any chunk is found on the wrong page
+
+#define SEQUENCE        0x1000
+
+namespace {
+    int failures = 0;
+
+    void check(const char* what, long page, long expected) {
+        if (page != expected) {
+            printf("%-56s page %ld, expected %ld\n", what, page, expected);
+            failures++;
+        }
+    }
+
+    //chunks firstChunk to lastChunk of an object on consecutive pages from firstPage
+    void addChunks(YaffsChunkMap& chunkMap, u32 objectId, u32 firstChunk, u32 lastChunk, u32 firstPage, u32 sequenceNumber) {
+        for (u32 chunk = firstChunk; chunk <= lastChunk; ++chunk) {
+            chunkMap.addChunk(objectId, chunk, firstPage + chunk - firstChunk, sequenceNumber);
+        }
+    }
+
+    //bytes the saved index takes with the given number of objects and extents
+    int indexSize(int numObjects, int numExtents) {
+        return sizeof(u32) + numObjects * sizeof(u32) * 3 + numExtents * sizeof(YaffsChunkMap::Extent);
+    }
+}
+
+int main() {
+    //object 300 has chunks 1-10 on pages 100-109, object 301 has chunks 1-10 on pages 200-209
+    YaffsChunkMap chunkMap;
+    addChunks(chunkMap, 300, 1, 10, 100, SEQUENCE);
+    addChunks(chunkMap, 301, 1, 10, 200, SEQUENCE);
+    chunkMap.build();
+    check("built: object 300 chunk 5", chunkMap.findPage(300, 5), 104);
+    check("built: object 301 chunk 10", chunkMap.findPage(301, 10), 209);
+
+    //blocks appended later rewrite chunks 3-4 of object 300 and add an object of their own
+    YaffsChunkMap appended;
+    addChunks(appended, 300, 3, 4, 500, SEQUENCE + 1);
+    addChunks(appended, 302, 1, 2, 502, SEQUENCE + 1);
+    chunkMap.append(appended);
+    chunkMap.build();
+    check("partial rewrite: chunk 1 wasn't rewritten", chunkMap.findPage(300, 1), 100);
+    check("partial rewrite: chunk 2 wasn't rewritten", chunkMap.findPage(300, 2), 101);
+    check("partial rewrite: chunk 3 was", chunkMap.findPage(300, 3), 500);
+    check("partial rewrite: chunk 4 was", chunkMap.findPage(300, 4), 501);
+    check("partial rewrite: chunk 5 wasn't rewritten", chunkMap.findPage(300, 5), 104);
+    check("partial rewrite: chunk 10 wasn't rewritten", chunkMap.findPage(300, 10), 109);
+    check("partial rewrite: chunk 11 never existed", chunkMap.findPage(300, 11), -1);
+    check("partial rewrite: other object untouched", chunkMap.findPage(301, 7), 206);
+    check("partial rewrite: new object", chunkMap.findPage(302, 2), 503);
+    check("partial rewrite: extents of 300", chunkMap.getExtents(300).size(), 3);
+
+    //the replaced extents are gone from the index: 300 has 1-2, 3-4, 5-10, the others one extent each
+    check("partial rewrite: saved index size", chunkMap.toByteArray().size(), indexSize(3, 5));
+    YaffsChunkMap loaded;
+    loaded.fromByteArray(chunkMap.toByteArray());
+    check("partial rewrite: chunk 2 after loading the index", loaded.findPage(300, 2), 101);
+    check("partial rewrite: chunk 4 after loading the index", loaded.findPage(300, 4), 501);
+
+    //object 301 is shrunk to 3 chunks and then chunk 6 is written again, 4, 5 and 7-10 read as holes
+    YaffsChunkMap resized;
+    resized.addShrink(301, 3 * CHUNK_SIZE - 100, 600, SEQUENCE + 2);
+    addChunks(resized, 301, 6, 6, 601, SEQUENCE + 2);
+    chunkMap.append(resized);
+    chunkMap.build();
+    check("shrink: chunk 3 is kept", chunkMap.findPage(301, 3), 202);
+    check("shrink: chunk 4 is cut off", chunkMap.findPage(301, 4), -1);
+    check("shrink: chunk 5 is cut off", chunkMap.findPage(301, 5), -1);
+    check("shrink: chunk 6 was written after the shrink", chunkMap.findPage(301, 6), 601);
+    check("shrink: chunk 7 is cut off", chunkMap.findPage(301, 7), -1);
+    check("shrink: object 300 untouched", chunkMap.findPage(300, 10), 109);
+    check("shrink: saved index size", chunkMap.toByteArray().size(), indexSize(3, 6));
+
+    //a shrink found in the same scan as the chunks only drops the ones written before it
+    YaffsChunkMap scanned;
+    addChunks(scanned, 400, 1, 8, 700, SEQUENCE);
+    scanned.addShrink(400, 2 * CHUNK_SIZE, 708, SEQUENCE);
+    addChunks(scanned, 400, 4, 4, 709, SEQUENCE);
+    addChunks(scanned, 401, 1, 4, 800, SEQUENCE + 1);
+    scanned.addShrink(401, 0, 760, SEQUENCE);
+    scanned.build();
+    check("one scan: chunk 2 is kept", scanned.findPage(400, 2), 701);
+    check("one scan: chunk 3 is cut off", scanned.findPage(400, 3), -1);
+    check("one scan: chunk 4 was written after the shrink", scanned.findPage(400, 4), 709);
+    check("one scan: chunk 5 is cut off", scanned.findPage(400, 5), -1);
+    check("one scan: an older shrink keeps newer chunks", scanned.findPage(401, 4), 803);
+
+    printf("%s\n", (failures == 0 ? "chunk map: all passed" : "chunk map: FAILED"));
+    return (failures == 0 ? 0 : 1);
+}
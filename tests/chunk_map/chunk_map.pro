@@ -0,0 +1,24 @@
+#-------------------------------------------------
+#
+# Checks YaffsChunkMap merging runs into a built map:
+# partial rewrites, shrinks and the saved index
+#
+#-------------------------------------------------
+
+QT        += core
+QT        -= gui
+CONFIG    += console
+CONFIG    -= app_bundle
+
+TARGET     = chunk_map
+TEMPLATE   = app
+
+INCLUDEPATH += ../..
+
+SOURCES   += \
+    chunk_map.cpp \
+    ../../YaffsChunkMap.cpp
+
+HEADERS   += \
+    ../../YaffsChunkMap.h \
+    ../../Yaffs2.h
@@ -0,0 +1,62 @@
+/*
+ * yaffey: Utility for reading, editing and writing YAFFS2 images
+ * Copyright (C) 2012 David Place <david.t.place@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef TEST_IMAGE_H
+#define TEST_IMAGE_H
+
+#include <QString>
+#include <QByteArray>
+
+#include <string.h>
+
+#include "Yaffs2.h"
+
+//Helpers for the tests that build images with YaffsControl
+
+//a header for an object in the root directory, with fixed attributes so every run writes the same image
+inline yaffs_obj_hdr makeHeader(yaffs_obj_type type, const QString& name, int fileSize) {
+    yaffs_obj_hdr header;
+    memset(&header, 0xff, sizeof(yaffs_obj_hdr));
+    memset(header.name, 0, sizeof(header.name));
+    memset(header.alias, 0, sizeof(header.alias));
+    strncpy(header.name, name.toLatin1().constData(), YAFFS_MAX_NAME_LENGTH);
+    header.type = type;
+    header.parent_obj_id = YAFFS_OBJECTID_ROOT;
+    header.yst_mode = (type == YAFFS_OBJECT_TYPE_DIRECTORY ? 040755 : 0100644);
+    header.yst_uid = 0;
+    header.yst_gid = 0;
+    header.yst_atime = 0;
+    header.yst_mtime = 0;
+    header.yst_ctime = 0;
+    header.file_size_low = fileSize;
+    return header;
+}
+
+//the content of every test file is a function of its index and the offset, so any range read back can be checked
+inline char patternByte(int fileIndex, qint64 offset) {
+    return static_cast<char>((fileIndex * 131 + offset * 7 + (offset >> 11) + (offset >> 20)) & 0xff);
+}
+
+//fills data with the content of a test file from offset on
+inline void fillPattern(QByteArray& data, int fileIndex, qint64 offset) {
+    for (int i = 0; i < data.size(); ++i) {
+        data[i] = patternByte(fileIndex, offset + i);
+    }
+}
+
+#endif  //TEST_IMAGE_H
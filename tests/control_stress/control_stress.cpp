@@ -0,0 +1,262 @@
+/*
+ * yaffey: Utility for reading, editing and writing YAFFS2 images
+ * Copyright (C) 2012 David Place <david.t.place@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <QDir>
+#include <QBuffer>
+#include <QThread>
+#include <QAtomicInt>
+#include <QVector>
+#include <QDebug>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "YaffsControl.h"
+#include "test_image.h"
+
+extern "C" {
+    #include "yaffs2/yaffs_hweight.h"
+}
+
+//Checks the thread-safety contract of YaffsControl: findFile() and readRange() on one instance opened with OPEN_READ,
+//from many threads at once, while another thread writes a second image out of the same instance with its own
+//YaffsControl. Every byte read is compared with what was written. Exits with 1 on any difference.
+
+#define NUM_FILES           96
+#define MAX_FILE_SIZE       (300 * 1024)
+#define READS_PER_THREAD    20000
+#define MAX_READ_LENGTH     (40 * 1024)
+
+namespace {
+    //a small generator per thread, qrand() isn't seeded the same on every thread
+    class Random {
+    public:
+        Random(u32 seed) : state(seed * 2654435761u + 1) {}
+        u32 next(u32 range) {
+            state = state * 1103515245u + 12345u;
+            return (state >> 8) % range;
+        }
+    private:
+        u32 state;
+    };
+
+    int fileSizeFor(int fileIndex, Random& random) {
+        //the edges of a chunk first, then anything up to MAX_FILE_SIZE
+        static const int edges[] = { 0, 1, CHUNK_SIZE - 1, CHUNK_SIZE, CHUNK_SIZE + 1, 64 * CHUNK_SIZE, 64 * CHUNK_SIZE + 7 };
+        int numEdges = sizeof(edges) / sizeof(edges[0]);
+        return (fileIndex < numEdges ? edges[fileIndex] : static_cast<int>(random.next(MAX_FILE_SIZE)));
+    }
+
+    struct TestFile {
+        int size;
+        int headerPos;
+    };
+
+    //random ranges of random files, each one checked byte for byte
+    class Reader : public QThread {
+    public:
+        Reader(const YaffsControl& control, const QVector<TestFile>& testFiles, int seed, QAtomicInt& errorCount) :
+            image(control), files(testFiles), random(seed), errors(errorCount) {
+        }
+
+        void run() {
+            QByteArray buffer(MAX_READ_LENGTH, 0);
+            for (int r = 0; r < READS_PER_THREAD; ++r) {
+                int fileIndex = random.next(files.size());
+                const TestFile& testFile = files.at(fileIndex);
+
+                YaffsFile yaffsFile;
+                if (!image.findFile(testFile.headerPos, yaffsFile) || yaffsFile.size != testFile.size) {
+                    errors.ref();
+                    continue;
+                }
+                if (testFile.size == 0) {
+                    continue;
+                }
+
+                long offset = random.next(testFile.size);
+                long length = qMin<long>(1 + random.next(MAX_READ_LENGTH), testFile.size - offset);
+                if (image.readRange(yaffsFile, offset, buffer.data(), length) != length) {
+                    errors.ref();
+                    continue;
+                }
+                for (long i = 0; i < length; ++i) {
+                    if (buffer.at(i) != patternByte(fileIndex, offset + i)) {
+                        errors.ref();
+                        break;
+                    }
+                }
+            }
+        }
+
+    private:
+        const YaffsControl& image;
+        const QVector<TestFile>& files;
+        Random random;
+        QAtomicInt& errors;
+    };
+
+    //copies every file of the shared image into a new one, reading through the same instance as the readers
+    class Writer : public QThread {
+    public:
+        Writer(const YaffsControl& control, const QVector<TestFile>& testFiles, const QString& imageFilename) :
+            image(control), files(testFiles), filename(imageFilename), result(false) {
+        }
+
+        void run() {
+            YaffsControl copy(filename.toStdString().c_str(), NULL);
+            if (!copy.open(YaffsControl::OPEN_NEW)) {
+                return;
+            }
+
+            int headerPos = -1;
+            copy.addRoot(makeHeader(YAFFS_OBJECT_TYPE_DIRECTORY, "", 0), headerPos);
+            headerPositions.resize(files.size());
+            bool copied = true;
+            for (int f = 0; f < files.size(); ++f) {
+                YaffsFile yaffsFile;
+                if (!image.findFile(files.at(f).headerPos, yaffsFile)) {
+                    copied = false;
+                    continue;
+                }
+                yaffs_obj_hdr header = makeHeader(YAFFS_OBJECT_TYPE_FILE, QString("copy%1").arg(f), files.at(f).size);
+                copy.addFile(header, headerPositions[f], image, yaffsFile, files.at(f).size);
+            }
+
+            YaffsSaveInfo saveInfo = copy.getSaveInfo();
+            result = (copy.flush() && copied && saveInfo.numFilesFailed == 0);
+            chunkMap = copy.getChunkMap();
+        }
+
+        const YaffsControl& image;
+        const QVector<TestFile>& files;
+        QString filename;
+        QVector<int> headerPositions;
+        YaffsChunkMap chunkMap;
+        bool result;
+    };
+
+    //reads every file back whole from an image on this thread
+    int checkImage(const QString& imageFilename, const YaffsChunkMap& chunkMap, const QVector<TestFile>& files,
+                   const QVector<int>& headerPositions) {
+        int errors = 0;
+        YaffsControl image(imageFilename.toStdString().c_str(), NULL);
+        image.setChunkMap(chunkMap);
+        if (!image.open(YaffsControl::OPEN_READ)) {
+            return files.size();
+        }
+
+        QByteArray data(MAX_FILE_SIZE, 0);
+        for (int f = 0; f < files.size(); ++f) {
+            YaffsFile yaffsFile;
+            if (!image.findFile(headerPositions.at(f), yaffsFile) || yaffsFile.size != files.at(f).size ||
+                image.readRange(yaffsFile, 0, data.data(), yaffsFile.size) != yaffsFile.size) {
+                errors++;
+                continue;
+            }
+            for (long i = 0; i < yaffsFile.size; ++i) {
+                if (data.at(i) != patternByte(f, i)) {
+                    errors++;
+                    break;
+                }
+            }
+        }
+        return errors;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    Q_UNUSED(argc);
+    Q_UNUSED(argv);
+
+    yaffs_hweight_init();
+
+    QString sourceFilename = QDir::tempPath() + "/control_stress_source.img";
+    QString copyFilename = QDir::tempPath() + "/control_stress_copy.img";
+
+    //the source image, written the way a serial save writes new files
+    QVector<TestFile> files(NUM_FILES);
+    YaffsChunkMap sourceChunkMap;
+    {
+        YaffsControl source(sourceFilename.toStdString().c_str(), NULL);
+        if (!source.open(YaffsControl::OPEN_NEW)) {
+            fprintf(stderr, "Can't create %s\n", qPrintable(sourceFilename));
+            return 1;
+        }
+
+        int headerPos = -1;
+        source.addRoot(makeHeader(YAFFS_OBJECT_TYPE_DIRECTORY, "", 0), headerPos);
+        Random random(1);
+        for (int f = 0; f < NUM_FILES; ++f) {
+            files[f].size = fileSizeFor(f, random);
+            QByteArray data(files[f].size, 0);
+            fillPattern(data, f, 0);
+
+            QBuffer buffer(&data);
+            buffer.open(QIODevice::ReadOnly);
+            source.addFile(makeHeader(YAFFS_OBJECT_TYPE_FILE, QString("file%1").arg(f), files[f].size), files[f].headerPos,
+                           buffer, files[f].size);
+        }
+
+        if (!source.flush() || source.getSaveInfo().numFilesFailed > 0) {
+            fprintf(stderr, "Failed to write %s\n", qPrintable(sourceFilename));
+            return 1;
+        }
+        sourceChunkMap = source.getChunkMap();
+        sourceChunkMap.build();
+    }
+
+    //one instance with the chunk map and one that walks from the headers, shared by every reader
+    YaffsControl mappedImage(sourceFilename.toStdString().c_str(), NULL);
+    mappedImage.setChunkMap(sourceChunkMap);
+    YaffsControl walkedImage(sourceFilename.toStdString().c_str(), NULL);
+    if (!mappedImage.open(YaffsControl::OPEN_READ) || !walkedImage.open(YaffsControl::OPEN_READ)) {
+        fprintf(stderr, "Can't open %s\n", qPrintable(sourceFilename));
+        return 1;
+    }
+
+    QAtomicInt readErrors(0);
+    QList<Reader*> readers;
+    int numReaders = qMax(4, 2 * QThread::idealThreadCount());
+    for (int r = 0; r < numReaders; ++r) {
+        readers.append(new Reader((r % 2) ? walkedImage : mappedImage, files, r + 2, readErrors));
+    }
+    Writer writer(mappedImage, files, copyFilename);
+
+    writer.start();
+    foreach (Reader* reader, readers) {
+        reader->start();
+    }
+    foreach (Reader* reader, readers) {
+        reader->wait();
+    }
+    writer.wait();
+    qDeleteAll(readers);
+
+    YaffsChunkMap copyChunkMap = writer.chunkMap;
+    copyChunkMap.build();
+    int copyErrors = (writer.result ? checkImage(copyFilename, copyChunkMap, files, writer.headerPositions) : NUM_FILES);
+
+    printf("%d readers x %d reads: %d errors\n", numReaders, READS_PER_THREAD, static_cast<int>(readErrors));
+    printf("concurrent copy of %d files: %d errors\n", NUM_FILES, copyErrors);
+
+    QFile::remove(sourceFilename);
+    QFile::remove(copyFilename);
+
+    return ((static_cast<int>(readErrors) == 0 && copyErrors == 0) ? 0 : 1);
+}
@@ -0,0 +1,30 @@
+#-------------------------------------------------
+#
+# Many threads reading one YaffsControl while another
+# writes a second image from it
+#
+#-------------------------------------------------
+
+QT        += core
+QT        -= gui
+CONFIG    += console
+CONFIG    -= app_bundle
+
+TARGET     = control_stress
+TEMPLATE   = app
+
+INCLUDEPATH += ../.. ../common
+
+SOURCES   += \
+    control_stress.cpp \
+    ../../YaffsControl.cpp \
+    ../../YaffsChunkMap.cpp \
+    ../../yaffs2/yaffs_packedtags2.c \
+    ../../yaffs2/yaffs_hweight.c \
+    ../../yaffs2/yaffs_ecc.c
+
+HEADERS   += \
+    ../common/test_image.h \
+    ../../YaffsControl.h \
+    ../../YaffsChunkMap.h \
+    ../../Yaffs2.h
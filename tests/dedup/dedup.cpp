@@ -0,0 +1,138 @@
+/*
+ * yaffey: Utility for reading, editing and writing YAFFS2 images
+ * Copyright (C) 2012 David Place <david.t.place@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+
+#include <stdio.h>
+
+#include "YaffsManager.h"
+#include "YaffsModel.h"
+
+//usage: dedup
+//exits with 1 if a file is linked to one with different attributes, or a copy with the same ones is written again
+
+#define FILE_SIZE   7000
+
+namespace {
+    int failures = 0;
+
+    void check(const char* what, int count, int expected) {
+        bool ok = (count == expected);
+        printf("%-48s %6d %s\n", what, count, (ok ? "" : "FAILED"));
+        if (!ok) {
+            failures++;
+        }
+    }
+
+    //only the counts in the read info are wanted
+    class NullObserver : public YaffsControlObserver {
+    public:
+        void newItem(int, const yaffs_obj_hdr*, int, bool) {}
+        void readComplete() {}
+    };
+
+    QString writeHostFile(const QString& path, char fill) {
+        QFile file(path);
+        file.open(QIODevice::WriteOnly);
+        file.write(QByteArray(FILE_SIZE, fill));
+        file.close();
+        return path;
+    }
+
+    //imports the files in one go, with the same times so that only their mode can set them apart
+    QList<YaffsItem*> importFiles(YaffsModel* model, YaffsItem* parentItem, const QStringList& hostFiles) {
+        int firstRow = parentItem->childCount();
+        model->beginTransaction();
+        foreach (const QString& hostFile, hostFiles) {
+            model->importFile(parentItem, hostFile);
+        }
+        model->commitTransaction();
+
+        QList<YaffsItem*> items;
+        for (int row = firstRow; row < parentItem->childCount(); ++row) {
+            YaffsItem* item = parentItem->child(row);
+            yaffs_obj_hdr header = item->getHeader();
+            header.yst_atime = 1000000000;
+            header.yst_mtime = 1000000000;
+            header.yst_ctime = 1000000000;
+            item->setHeader(header);
+            items.append(item);
+        }
+        return items;
+    }
+
+    YaffsReadInfo readImage(const QString& imageFilename) {
+        NullObserver observer;
+        YaffsControl yaffsControl(imageFilename.toStdString().c_str(), &observer);
+        yaffsControl.open(YaffsControl::OPEN_READ);
+        yaffsControl.readImage();
+        return yaffsControl.getReadInfo();
+    }
+}
+
+int main(int argc, char* argv[]) {
+    QCoreApplication application(argc, argv);
+
+    QString hostDirectory = QDir::tempPath() + "/dedup";
+    QDir().mkpath(hostDirectory);
+    QStringList hostFiles;
+    hostFiles << writeHostFile(hostDirectory + "/same0", 'a')
+              << writeHostFile(hostDirectory + "/same1", 'a')
+              << writeHostFile(hostDirectory + "/same2", 'a')
+              << writeHostFile(hostDirectory + "/other", 'b');
+    QString imageFilename = QDir::tempPath() + "/dedup.img";
+
+    YaffsManager* manager = YaffsManager::getInstance();
+    YaffsModel* model = manager->newModel();
+    model->newImage("dedup_new.img");
+    QModelIndex rootIndex = model->index(0, 0);
+    YaffsItem* rootItem = static_cast<YaffsItem*>(rootIndex.internalPointer());
+
+    //same2 has the data of same0 and same1 but another mode, so it has to keep its own copy
+    QList<YaffsItem*> items = importFiles(model, rootItem, hostFiles);
+    model->setData(model->index(items.at(2)->row(), YaffsItem::PERMISSIONS, rootIndex), 0100600);
+
+    model->setDeduplicate(true);
+    YaffsSaveInfo saveInfo = model->saveAs(imageFilename, 0);
+    check("save as: saved", saveInfo.result, 1);
+    check("save as: files written", saveInfo.numFilesSaved, 3);
+    check("save as: hard links written", saveInfo.numHardLinksSaved, 1);
+
+    //appended copies link to the files already in the image, same4 to the one with the other mode
+    QStringList newFiles;
+    newFiles << writeHostFile(hostDirectory + "/same3", 'a')
+             << writeHostFile(hostDirectory + "/same4", 'a');
+    items = importFiles(model, rootItem, newFiles);
+    model->setData(model->index(items.at(1)->row(), YaffsItem::PERMISSIONS, rootIndex), 0100600);
+    check("save: saved", model->save(), 1);
+
+    YaffsReadInfo readInfo = readImage(imageFilename);
+    check("image read back: files", readInfo.numFiles, 3);
+    check("image read back: hard links", readInfo.numHardLinks, 3);
+
+    hostFiles += newFiles;
+    foreach (const QString& hostFile, hostFiles) {
+        QFile::remove(hostFile);
+    }
+    QDir().rmdir(hostDirectory);
+    QFile::remove(imageFilename);
+
+    return (failures == 0 ? 0 : 1);
+}
@@ -0,0 +1,46 @@
+#-------------------------------------------------
+#
+# Saves files with the same data, some with different
+# attributes, with deduplication on, both as a new image
+# and appended to it
+#
+#-------------------------------------------------
+
+QT        += core gui
+CONFIG    += console
+CONFIG    -= app_bundle
+
+TARGET     = dedup
+TEMPLATE   = app
+
+INCLUDEPATH += ../..
+
+SOURCES   += \
+    dedup.cpp \
+    ../../YaffsModel.cpp \
+    ../../YaffsItem.cpp \
+    ../../YaffsManager.cpp \
+    ../../YaffsControl.cpp \
+    ../../YaffsIndex.cpp \
+    ../../YaffsObjectTable.cpp \
+    ../../YaffsChunkMap.cpp \
+    ../../YaffsFileDevice.cpp \
+    ../../YaffsWriter.cpp \
+    ../../YaffsImporter.cpp \
+    ../../yaffs2/yaffs_packedtags2.c \
+    ../../yaffs2/yaffs_hweight.c \
+    ../../yaffs2/yaffs_ecc.c
+
+HEADERS   += \
+    ../../YaffsModel.h \
+    ../../YaffsItem.h \
+    ../../YaffsManager.h \
+    ../../YaffsControl.h \
+    ../../YaffsIndex.h \
+    ../../YaffsObjectTable.h \
+    ../../YaffsChunkMap.h \
+    ../../YaffsFileDevice.h \
+    ../../YaffsWriter.h \
+    ../../YaffsImporter.h \
+    ../../AndroidIDs.h \
+    ../../Yaffs2.h
@@ -0,0 +1,293 @@
+/*
+ * yaffey: Utility for reading, editing and writing YAFFS2 images
+ * Copyright (C) 2012 David Place <david.t.place@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "yaffs_ecc.h"
+#include "yaffs_hweight.h"
+
+//usage: ecc_bench [megabytes per kernel, 256 by default]
+//exits with 1 if any result differs from the original code
+
+#define BLOCK_SIZE      256
+#define CHUNK_BYTES     2048
+#define BUFFER_SIZE     (1024 * 1024)
+#define CHECK_BLOCKS    200000
+#define CHECK_WORDS     20000000
+
+//the original yaffs_ecc.c, a table lookup per byte
+static const unsigned char column_parity_table[] = {
+    0x00, 0x55, 0x59, 0x0c, 0x65, 0x30, 0x3c, 0x69,
+    0x69, 0x3c, 0x30, 0x65, 0x0c, 0x59, 0x55, 0x00,
+    0x95, 0xc0, 0xcc, 0x99, 0xf0, 0xa5, 0xa9, 0xfc,
+    0xfc, 0xa9, 0xa5, 0xf0, 0x99, 0xcc, 0xc0, 0x95,
+    0x99, 0xcc, 0xc0, 0x95, 0xfc, 0xa9, 0xa5, 0xf0,
+    0xf0, 0xa5, 0xa9, 0xfc, 0x95, 0xc0, 0xcc, 0x99,
+    0x0c, 0x59, 0x55, 0x00, 0x69, 0x3c, 0x30, 0x65,
+    0x65, 0x30, 0x3c, 0x69, 0x00, 0x55, 0x59, 0x0c,
+    0xa5, 0xf0, 0xfc, 0xa9, 0xc0, 0x95, 0x99, 0xcc,
+    0xcc, 0x99, 0x95, 0xc0, 0xa9, 0xfc, 0xf0, 0xa5,
+    0x30, 0x65, 0x69, 0x3c, 0x55, 0x00, 0x0c, 0x59,
+    0x59, 0x0c, 0x00, 0x55, 0x3c, 0x69, 0x65, 0x30,
+    0x3c, 0x69, 0x65, 0x30, 0x59, 0x0c, 0x00, 0x55,
+    0x55, 0x00, 0x0c, 0x59, 0x30, 0x65, 0x69, 0x3c,
+    0xa9, 0xfc, 0xf0, 0xa5, 0xcc, 0x99, 0x95, 0xc0,
+    0xc0, 0x95, 0x99, 0xcc, 0xa5, 0xf0, 0xfc, 0xa9,
+    0xa9, 0xfc, 0xf0, 0xa5, 0xcc, 0x99, 0x95, 0xc0,
+    0xc0, 0x95, 0x99, 0xcc, 0xa5, 0xf0, 0xfc, 0xa9,
+    0x3c, 0x69, 0x65, 0x30, 0x59, 0x0c, 0x00, 0x55,
+    0x55, 0x00, 0x0c, 0x59, 0x30, 0x65, 0x69, 0x3c,
+    0x30, 0x65, 0x69, 0x3c, 0x55, 0x00, 0x0c, 0x59,
+    0x59, 0x0c, 0x00, 0x55, 0x3c, 0x69, 0x65, 0x30,
+    0xa5, 0xf0, 0xfc, 0xa9, 0xc0, 0x95, 0x99, 0xcc,
+    0xcc, 0x99, 0x95, 0xc0, 0xa9, 0xfc, 0xf0, 0xa5,
+    0x0c, 0x59, 0x55, 0x00, 0x69, 0x3c, 0x30, 0x65,
+    0x65, 0x30, 0x3c, 0x69, 0x00, 0x55, 0x59, 0x0c,
+    0x99, 0xcc, 0xc0, 0x95, 0xfc, 0xa9, 0xa5, 0xf0,
+    0xf0, 0xa5, 0xa9, 0xfc, 0x95, 0xc0, 0xcc, 0x99,
+    0x95, 0xc0, 0xcc, 0x99, 0xf0, 0xa5, 0xa9, 0xfc,
+    0xfc, 0xa9, 0xa5, 0xf0, 0x99, 0xcc, 0xc0, 0x95,
+    0x00, 0x55, 0x59, 0x0c, 0x65, 0x30, 0x3c, 0x69,
+    0x69, 0x3c, 0x30, 0x65, 0x0c, 0x59, 0x55, 0x00,
+};
+
+static void reference_ecc_calc(const unsigned char* data, unsigned char* ecc) {
+    unsigned int i;
+    unsigned char col_parity = 0;
+    unsigned char line_parity = 0;
+    unsigned char line_parity_prime = 0;
+    unsigned char t;
+    unsigned char b;
+    int bit;
+
+    for (i = 0; i < BLOCK_SIZE; i++) {
+        b = column_parity_table[*data++];
+        col_parity ^= b;
+        if (b & 0x01) {
+            line_parity ^= i;
+            line_parity_prime ^= ~i;
+        }
+    }
+
+    ecc[2] = (~col_parity) | 0x03;
+
+    //line parity bits 7..4 then 3..0, each followed by its prime
+    t = 0;
+    for (bit = 7; bit >= 4; --bit) {
+        t = (t << 2) | (((line_parity >> bit) & 1) << 1) | ((line_parity_prime >> bit) & 1);
+    }
+    ecc[1] = ~t;
+    t = 0;
+    for (bit = 3; bit >= 0; --bit) {
+        t = (t << 2) | (((line_parity >> bit) & 1) << 1) | ((line_parity_prime >> bit) & 1);
+    }
+    ecc[0] = ~t;
+}
+
+static void reference_ecc_calc_other(const unsigned char* data, unsigned n_bytes, struct yaffs_ecc_other* ecc_other) {
+    unsigned int i;
+    unsigned char col_parity = 0;
+    unsigned line_parity = 0;
+    unsigned line_parity_prime = 0;
+    unsigned char b;
+
+    for (i = 0; i < n_bytes; i++) {
+        b = column_parity_table[*data++];
+        col_parity ^= b;
+        if (b & 0x01) {
+            line_parity ^= i;
+            line_parity_prime ^= ~i;
+        }
+    }
+
+    ecc_other->col_parity = (col_parity >> 2) & 0x3f;
+    ecc_other->line_parity = line_parity;
+    ecc_other->line_parity_prime = line_parity_prime;
+}
+
+static int reference_hweight32(u32 x) {
+    return yaffs_hweight8(x & 0xff) + yaffs_hweight8((x >> 8) & 0xff) +
+           yaffs_hweight8((x >> 16) & 0xff) + yaffs_hweight8((x >> 24) & 0xff);
+}
+
+static void fill_random(unsigned char* data, int size) {
+    int i;
+    for (i = 0; i < size; ++i) {
+        data[i] = rand() & 0xff;
+    }
+}
+
+static u32 random32(void) {
+    return ((u32)(rand() & 0xffff) << 16) ^ (u32)(rand() & 0xffff);
+}
+
+static int check_ecc(void) {
+    unsigned char block[CHUNK_BYTES];
+    unsigned char ecc[3];
+    unsigned char reference[3];
+    unsigned char corrupted_ecc[3];
+    struct yaffs_ecc_other other;
+    struct yaffs_ecc_other reference_other;
+    int failures = 0;
+    int i;
+
+    for (i = 0; i < CHECK_BLOCKS; ++i) {
+        //all zeros and all ones as well as random data
+        if (i == 0 || i == 1) {
+            memset(block, (i == 0 ? 0x00 : 0xff), sizeof(block));
+        } else {
+            fill_random(block, sizeof(block));
+        }
+
+        yaffs_ecc_calc(block, ecc);
+        reference_ecc_calc(block, reference);
+        if (memcmp(ecc, reference, 3) != 0) {
+            failures++;
+        }
+
+        //a single flipped bit is found and corrected
+        int bit = rand() % (BLOCK_SIZE * 8);
+        unsigned char original = block[bit / 8];
+        block[bit / 8] ^= (1 << (bit % 8));
+        yaffs_ecc_calc(block, corrupted_ecc);
+        if (yaffs_ecc_correct(block, ecc, corrupted_ecc) != 1 || block[bit / 8] != original) {
+            failures++;
+        }
+
+        unsigned n_bytes = rand() % (CHUNK_BYTES + 1);
+        yaffs_ecc_calc_other(block, n_bytes, &other);
+        reference_ecc_calc_other(block, n_bytes, &reference_other);
+        if (other.col_parity != reference_other.col_parity || other.line_parity != reference_other.line_parity ||
+            other.line_parity_prime != reference_other.line_parity_prime) {
+            failures++;
+        }
+    }
+
+    printf("ecc:       %d blocks checked, %d differences\n", CHECK_BLOCKS, failures);
+    return failures;
+}
+
+static int check_hweight(void) {
+    int failures = 0;
+    int i;
+
+    for (i = 0; i < CHECK_WORDS; ++i) {
+        u32 x = (i < 64 ? (1u << (i % 32)) - (i / 32) : random32());
+        if (yaffs_hweight32(x) != reference_hweight32(x)) {
+            failures++;
+        }
+    }
+
+    printf("hweight32: %d words checked, %d differences\n", CHECK_WORDS, failures);
+    return failures;
+}
+
+static double seconds_since(clock_t start) {
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static void report(const char* kernel, double bytes, double seconds) {
+    printf("%-34s %8.3f GB/s\n", kernel, (seconds > 0.0 ? bytes / seconds / 1e9 : 0.0));
+}
+
+int main(int argc, char* argv[]) {
+    int megabytes = (argc > 1 ? atoi(argv[1]) : 256);
+    unsigned char* buffer = (unsigned char*)malloc(BUFFER_SIZE);
+    volatile unsigned sink = 0;
+    unsigned char ecc[3];
+    struct yaffs_ecc_other other;
+    clock_t start;
+    int failures;
+    int pass;
+    int i;
+
+    if (buffer == NULL || megabytes < 1) {
+        fprintf(stderr, "usage: ecc_bench [megabytes per kernel]\n");
+        return 2;
+    }
+
+    yaffs_hweight_init();
+    srand(1);
+
+    failures = check_ecc() + check_hweight();
+
+    fill_random(buffer, BUFFER_SIZE);
+    double bytes = (double)megabytes * BUFFER_SIZE;
+
+    start = clock();
+    for (pass = 0; pass < megabytes; ++pass) {
+        for (i = 0; i < BUFFER_SIZE; i += BLOCK_SIZE) {
+            reference_ecc_calc(buffer + i, ecc);
+            sink += ecc[0] + ecc[1] + ecc[2];
+        }
+    }
+    report("ecc_calc, original", bytes, seconds_since(start));
+
+    start = clock();
+    for (pass = 0; pass < megabytes; ++pass) {
+        for (i = 0; i < BUFFER_SIZE; i += BLOCK_SIZE) {
+            yaffs_ecc_calc(buffer + i, ecc);
+            sink += ecc[0] + ecc[1] + ecc[2];
+        }
+    }
+    report("yaffs_ecc_calc", bytes, seconds_since(start));
+
+    start = clock();
+    for (pass = 0; pass < megabytes; ++pass) {
+        for (i = 0; i < BUFFER_SIZE; i += CHUNK_BYTES) {
+            reference_ecc_calc_other(buffer + i, CHUNK_BYTES, &other);
+            sink += other.line_parity;
+        }
+    }
+    report("ecc_calc_other, original", bytes, seconds_since(start));
+
+    start = clock();
+    for (pass = 0; pass < megabytes; ++pass) {
+        for (i = 0; i < BUFFER_SIZE; i += CHUNK_BYTES) {
+            yaffs_ecc_calc_other(buffer + i, CHUNK_BYTES, &other);
+            sink += other.line_parity;
+        }
+    }
+    report("yaffs_ecc_calc_other", bytes, seconds_since(start));
+
+    //hweight32 is counted over the bytes of the words it is given
+    const u32* words = (const u32*)buffer;
+    int numWords = BUFFER_SIZE / sizeof(u32);
+
+    start = clock();
+    for (pass = 0; pass < megabytes; ++pass) {
+        for (i = 0; i < numWords; ++i) {
+            sink += reference_hweight32(words[i]);
+        }
+    }
+    report("hweight32, table", bytes, seconds_since(start));
+
+    start = clock();
+    for (pass = 0; pass < megabytes; ++pass) {
+        for (i = 0; i < numWords; ++i) {
+            sink += yaffs_hweight32(words[i]);
+        }
+    }
+    report("yaffs_hweight32", bytes, seconds_since(start));
+
+    free(buffer);
+    return (failures == 0 ? 0 : 1);
+}
@@ -0,0 +1,19 @@
+#-------------------------------------------------
+#
+# Checks the ECC and hweight code against the original
+# byte at a time versions and reports GB/s for each
+#
+#-------------------------------------------------
+
+CONFIG    += console
+CONFIG    -= qt app_bundle
+
+TARGET     = ecc_bench
+TEMPLATE   = app
+
+INCLUDEPATH += ../../yaffs2
+
+SOURCES   += \
+    ecc_bench.c \
+    ../../yaffs2/yaffs_ecc.c \
+    ../../yaffs2/yaffs_hweight.c
@@ -0,0 +1,165 @@
+/*
+ * yaffey: Utility for reading, editing and writing YAFFS2 images
+ * Copyright (C) 2012 David Place <david.t.place@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QElapsedTimer>
+#include <QThread>
+
+#include <stdio.h>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif  //Q_OS_UNIX
+
+#include "YaffsImporter.h"
+
+//usage: import_walk [number of files, 50000 by default]
+//       import_walk -d <existing directory>
+//exits with 1 if the importer doesn't find the same entries as the serial walk
+
+#define FILES_PER_DIR       100
+#define DIRS_PER_DIR        50
+
+namespace {
+    //the serial walk importDirectory() used to do, a QFileInfo for every entry. links to directories are left out
+    //as the importer leaves them out.
+    int walkSerial(const QString& path) {
+        int entries = 1;
+        QDirIterator dirs(path, QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System);
+        while (dirs.hasNext()) {
+            dirs.next();
+            QFileInfo fileInfo = dirs.fileInfo();
+            if (fileInfo.isDir()) {
+                if (!fileInfo.isSymLink()) {
+                    entries += walkSerial(fileInfo.absoluteFilePath());
+                }
+            } else if (fileInfo.isFile()) {
+                entries++;
+            }
+        }
+        return entries;
+    }
+
+    int countEntries(const YaffsImportEntry* entry) {
+        int entries = 1;
+        foreach (const YaffsImportEntry* childEntry, entry->children) {
+            entries += countEntries(childEntry);
+        }
+        return entries;
+    }
+
+    //directories of FILES_PER_DIR empty files, DIRS_PER_DIR of them under each top level directory.
+    //returns the number of entries including the root.
+    int makeTree(const QString& path, int numFiles) {
+        int entries = 1;
+        QDir().mkpath(path);
+        for (int f = 0; f < numFiles; ++f) {
+            int dir = f / FILES_PER_DIR;
+            QString dirPath = path + QString("/top%1/dir%2").arg(dir / DIRS_PER_DIR).arg(dir);
+            if (f % FILES_PER_DIR == 0) {
+                if (dir % DIRS_PER_DIR == 0) {
+                    entries++;
+                }
+                QDir().mkpath(dirPath);
+                entries++;
+            }
+            QFile file(dirPath + QString("/file%1").arg(f));
+            file.open(QIODevice::WriteOnly);
+            file.close();
+            entries++;
+        }
+
+#ifdef Q_OS_UNIX
+        //a link back to the root must not be followed, a link to a file is imported as the file
+        if (numFiles > 0 && symlink("../..", QFile::encodeName(path + "/top0/dir0/loop").constData()) == 0 &&
+            symlink("file0", QFile::encodeName(path + "/top0/dir0/link").constData()) == 0) {
+            entries++;
+        }
+#endif  //Q_OS_UNIX
+
+        return entries;
+    }
+
+    void removeTree(const QString& path) {
+        QDirIterator dirs(path, QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System);
+        while (dirs.hasNext()) {
+            dirs.next();
+            QFileInfo fileInfo = dirs.fileInfo();
+            if (fileInfo.isDir() && !fileInfo.isSymLink()) {
+                removeTree(fileInfo.absoluteFilePath());
+            } else {
+                QFile::remove(fileInfo.absoluteFilePath());
+            }
+        }
+        QDir().rmdir(path);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    QCoreApplication application(argc, argv);
+
+    QString path;
+    int expectedEntries = -1;
+    bool madeTree = false;
+    if (argc > 2 && QString(argv[1]) == "-d") {
+        path = QFileInfo(QString(argv[2])).absoluteFilePath();
+    } else {
+        int numFiles = (argc > 1 ? QString(argv[1]).toInt() : 50000);
+        if (numFiles <= 0) {
+            fprintf(stderr, "usage: import_walk [number of files] | -d <directory>\n");
+            return 1;
+        }
+        path = QDir::tempPath() + "/import_walk";
+        removeTree(path);
+        expectedEntries = makeTree(path, numFiles);
+        madeTree = true;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    int serialEntries = walkSerial(path);
+    double serialSeconds = timer.elapsed() / 1000.0;
+
+    timer.restart();
+    YaffsImporter importer(path);
+    importer.start();
+    importer.wait();
+    YaffsImportEntry* tree = importer.takeTree();
+    double importerSeconds = timer.elapsed() / 1000.0;
+    int importerEntries = (tree ? countEntries(tree) : 0);
+    delete tree;
+
+    printf("%s\n", qPrintable(path));
+    printf("serial walk: %8d entries in %7.3f s\n", serialEntries, serialSeconds);
+    printf("importer:    %8d entries in %7.3f s on %d threads\n", importerEntries, importerSeconds, QThread::idealThreadCount());
+
+    bool result = (importerEntries == serialEntries && (expectedEntries < 0 || importerEntries == expectedEntries));
+    if (!result) {
+        printf("FAILED, expected %d entries\n", (expectedEntries < 0 ? serialEntries : expectedEntries));
+    }
+
+    if (madeTree) {
+        removeTree(path);
+    }
+
+    return (result ? 0 : 1);
+}
@@ -0,0 +1,23 @@
+#-------------------------------------------------
+#
+# Times YaffsImporter reading a host tree against
+# a serial QDirIterator walk of the same tree
+#
+#-------------------------------------------------
+
+QT        += core
+QT        -= gui
+CONFIG    += console
+CONFIG    -= app_bundle
+
+TARGET     = import_walk
+TEMPLATE   = app
+
+INCLUDEPATH += ../..
+
+SOURCES   += \
+    import_walk.cpp \
+    ../../YaffsImporter.cpp
+
+HEADERS   += \
+    ../../YaffsImporter.h
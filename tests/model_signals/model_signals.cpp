@@ -0,0 +1,156 @@
+/*
+ * yaffey: Utility for reading, editing and writing YAFFS2 images
+ * Copyright (C) 2012 David Place <david.t.place@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <QCoreApplication>
+#include <QSignalSpy>
+#include <QDir>
+#include <QFile>
+
+#include <stdio.h>
+
+#include "YaffsManager.h"
+#include "YaffsModel.h"
+
+//usage: model_signals [number of files, 1000 by default]
+//exits with 1 if a bulk edit in a transaction emits more than one signal of a kind, or any edit emits layoutChanged()
+
+namespace {
+    int failures = 0;
+
+    void check(const char* what, int count, int expected) {
+        bool ok = (count == expected);
+        printf("%-48s %6d %s\n", what, count, (ok ? "" : "FAILED"));
+        if (!ok) {
+            failures++;
+        }
+    }
+
+    //the number of rows covered by the rowsInserted() or rowsRemoved() signals a spy caught
+    int rowsSignalled(const QSignalSpy& spy) {
+        int rows = 0;
+        for (int i = 0; i < spy.size(); ++i) {
+            rows += spy.at(i).at(2).toInt() - spy.at(i).at(1).toInt() + 1;
+        }
+        return rows;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    QCoreApplication application(argc, argv);
+    qRegisterMetaType<QModelIndex>("QModelIndex");
+
+    int numFiles = (argc > 1 ? QString(argv[1]).toInt() : 1000);
+    if (numFiles <= 0) {
+        fprintf(stderr, "usage: model_signals [number of files]\n");
+        return 1;
+    }
+
+    //the files only have to exist, importFile() reads nothing but their size
+    QString hostDirectory = QDir::tempPath() + "/model_signals";
+    QDir().mkpath(hostDirectory);
+    QStringList hostFiles;
+    for (int i = 0; i < numFiles; ++i) {
+        QFile file(hostDirectory + QString("/file%1").arg(i));
+        file.open(QIODevice::WriteOnly);
+        file.close();
+        hostFiles.append(file.fileName());
+    }
+
+    YaffsManager* manager = YaffsManager::getInstance();
+    YaffsModel* model = manager->newModel();
+    model->newImage("model_signals.img");
+    QModelIndex rootIndex = model->index(0, 0);
+    YaffsItem* rootItem = static_cast<YaffsItem*>(rootIndex.internalPointer());
+
+    QSignalSpy inserted(model, SIGNAL(rowsInserted(const QModelIndex&, int, int)));
+    QSignalSpy removed(model, SIGNAL(rowsRemoved(const QModelIndex&, int, int)));
+    QSignalSpy changed(model, SIGNAL(dataChanged(const QModelIndex&, const QModelIndex&)));
+    QSignalSpy layout(model, SIGNAL(layoutChanged()));
+    QSignalSpy modelChanged(manager, SIGNAL(modelChanged()));
+
+    printf("%d files\n", numFiles);
+
+    //one file at a time, as before transactions, still one insertion each but no relayout
+    foreach (const QString& hostFile, hostFiles) {
+        model->importFile(rootItem, hostFile);
+    }
+    check("imported one at a time: rowsInserted()", inserted.size(), numFiles);
+    check("imported one at a time: layoutChanged()", layout.size(), 0);
+    check("imported one at a time: modelChanged()", modelChanged.size(), numFiles);
+
+    inserted.clear();
+    modelChanged.clear();
+    model->beginTransaction();
+    foreach (const QString& hostFile, hostFiles) {
+        model->importFile(rootItem, hostFile);
+    }
+    check("imported in a transaction: before commit", inserted.size(), 0);
+    model->commitTransaction();
+    check("imported in a transaction: rowsInserted()", inserted.size(), 1);
+    check("imported in a transaction: rows inserted", rowsSignalled(inserted), numFiles);
+    check("imported in a transaction: modelChanged()", modelChanged.size(), 1);
+
+    //nested transactions only show their changes at the outermost commit
+    changed.clear();
+    modelChanged.clear();
+    model->beginTransaction();
+    model->beginTransaction();
+    for (int row = 0; row < 2 * numFiles; ++row) {
+        model->setData(model->index(row, YaffsItem::PERMISSIONS, rootIndex), 0100600);
+    }
+    model->commitTransaction();
+    check("edited in a nested transaction: before commit", changed.size(), 0);
+    model->commitTransaction();
+    check("edited in a nested transaction: dataChanged()", changed.size(), 1);
+    check("edited in a nested transaction: modelChanged()", modelChanged.size(), 1);
+
+    //the second half are one contiguous range
+    removed.clear();
+    modelChanged.clear();
+    QModelIndexList selectedRows;
+    for (int row = numFiles; row < 2 * numFiles; ++row) {
+        selectedRows.append(model->index(row, 0, rootIndex));
+    }
+    model->removeRows(selectedRows);
+    check("removed a contiguous selection: rowsRemoved()", removed.size(), 1);
+    check("removed a contiguous selection: rows removed", rowsSignalled(removed), numFiles);
+    check("removed a contiguous selection: modelChanged()", modelChanged.size(), 1);
+
+    //rows removed one at a time in a transaction keep their rows until the commit, which removes them as one range
+    removed.clear();
+    modelChanged.clear();
+    model->beginTransaction();
+    for (int row = 0; row < numFiles; ++row) {
+        model->removeRows(QModelIndexList() << model->index(row, 0, rootIndex));
+    }
+    check("removed in a transaction: before commit", removed.size(), 0);
+    check("removed in a transaction: rows left before commit", model->rowCount(rootIndex), numFiles);
+    model->commitTransaction();
+    check("removed in a transaction: rowsRemoved()", removed.size(), 1);
+    check("removed in a transaction: rows removed", rowsSignalled(removed), numFiles);
+    check("removed in a transaction: modelChanged()", modelChanged.size(), 1);
+    check("removed in a transaction: rows left", model->rowCount(rootIndex), 0);
+    check("every edit: layoutChanged()", layout.size(), 0);
+
+    foreach (const QString& hostFile, hostFiles) {
+        QFile::remove(hostFile);
+    }
+    QDir().rmdir(hostDirectory);
+
+    return (failures == 0 ? 0 : 1);
+}
@@ -0,0 +1,45 @@
+#-------------------------------------------------
+#
+# Counts the signals YaffsModel and YaffsManager emit
+# for bulk edits, with and without a transaction
+#
+#-------------------------------------------------
+
+QT        += core gui
+CONFIG    += console qtestlib
+CONFIG    -= app_bundle
+
+TARGET     = model_signals
+TEMPLATE   = app
+
+INCLUDEPATH += ../..
+
+SOURCES   += \
+    model_signals.cpp \
+    ../../YaffsModel.cpp \
+    ../../YaffsItem.cpp \
+    ../../YaffsManager.cpp \
+    ../../YaffsControl.cpp \
+    ../../YaffsIndex.cpp \
+    ../../YaffsObjectTable.cpp \
+    ../../YaffsChunkMap.cpp \
+    ../../YaffsFileDevice.cpp \
+    ../../YaffsWriter.cpp \
+    ../../YaffsImporter.cpp \
+    ../../yaffs2/yaffs_packedtags2.c \
+    ../../yaffs2/yaffs_hweight.c \
+    ../../yaffs2/yaffs_ecc.c
+
+HEADERS   += \
+    ../../YaffsModel.h \
+    ../../YaffsItem.h \
+    ../../YaffsManager.h \
+    ../../YaffsControl.h \
+    ../../YaffsIndex.h \
+    ../../YaffsObjectTable.h \
+    ../../YaffsChunkMap.h \
+    ../../YaffsFileDevice.h \
+    ../../YaffsWriter.h \
+    ../../YaffsImporter.h \
+    ../../AndroidIDs.h \
+    ../../Yaffs2.h
@@ -0,0 +1,144 @@
+/*
+ * yaffey: Utility for reading, editing and writing YAFFS2 images
+ * Copyright (C) 2012 David Place <david.t.place@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <QDir>
+#include <QFile>
+#include <QElapsedTimer>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif  //Q_OS_UNIX
+
+#include "YaffsControl.h"
+#include "test_image.h"
+
+extern "C" {
+    #include "yaffs2/yaffs_hweight.h"
+}
+
+//usage: stream_import [megabytes, 1024 by default] [directory for the files, the temp directory by default]
+//exits with 1 if the file read back from the image differs, or adding it grew the peak memory by more than a quarter of its size
+
+#define STEP_SIZE       (1024 * 1024)
+
+namespace {
+    //peak resident set size in bytes, 0 where it isn't known
+    qint64 peakResidentBytes() {
+#ifdef Q_OS_UNIX
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef Q_OS_MAC
+            return usage.ru_maxrss;
+#else
+            return static_cast<qint64>(usage.ru_maxrss) * 1024;
+#endif  //Q_OS_MAC
+        }
+#endif  //Q_OS_UNIX
+        return 0;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int megabytes = (argc > 1 ? atoi(argv[1]) : 1024);
+    QString directory = (argc > 2 ? QString(argv[2]) : QDir::tempPath());
+    if (megabytes <= 0 || megabytes > 2047) {
+        fprintf(stderr, "usage: stream_import [megabytes, up to 2047] [directory]\n");
+        return 1;
+    }
+
+    yaffs_hweight_init();
+
+    QString hostFilename = directory + "/stream_import.bin";
+    QString imageFilename = directory + "/stream_import.img";
+    int fileSize = megabytes * 1024 * 1024;
+
+    //the host file is written a step at a time so making it doesn't raise the peak either
+    QByteArray step(STEP_SIZE, 0);
+    {
+        QFile hostFile(hostFilename);
+        if (!hostFile.open(QIODevice::WriteOnly)) {
+            fprintf(stderr, "Can't create %s\n", qPrintable(hostFilename));
+            return 1;
+        }
+        for (qint64 offset = 0; offset < fileSize; offset += STEP_SIZE) {
+            fillPattern(step, 0, offset);
+            hostFile.write(step);
+        }
+    }
+
+    qint64 peakBefore = peakResidentBytes();
+    QElapsedTimer timer;
+    timer.start();
+
+    int headerPos = -1;
+    bool written = false;
+    YaffsChunkMap chunkMap;
+    {
+        YaffsControl image(imageFilename.toStdString().c_str(), NULL);
+        QFile hostFile(hostFilename);
+        if (image.open(YaffsControl::OPEN_NEW) && hostFile.open(QIODevice::ReadOnly)) {
+            int rootPos = -1;
+            image.addRoot(makeHeader(YAFFS_OBJECT_TYPE_DIRECTORY, "", 0), rootPos);
+            image.addFile(makeHeader(YAFFS_OBJECT_TYPE_FILE, "stream_import.bin", fileSize), headerPos, hostFile, fileSize);
+            written = (image.flush() && image.getSaveInfo().numFilesSaved == 1);
+            chunkMap = image.getChunkMap();
+        }
+    }
+
+    double seconds = timer.elapsed() / 1000.0;
+    qint64 peakGrowth = peakResidentBytes() - peakBefore;
+
+    //read back a step at a time through the chunk map
+    int differences = 0;
+    if (written) {
+        chunkMap.build();
+        YaffsControl image(imageFilename.toStdString().c_str(), NULL);
+        image.setChunkMap(chunkMap);
+        YaffsFile yaffsFile;
+        if (image.open(YaffsControl::OPEN_READ) && image.findFile(headerPos, yaffsFile) && yaffsFile.size == fileSize) {
+            for (qint64 offset = 0; offset < fileSize; offset += STEP_SIZE) {
+                if (image.readRange(yaffsFile, offset, step.data(), STEP_SIZE) != STEP_SIZE) {
+                    differences++;
+                    continue;
+                }
+                for (int i = 0; i < STEP_SIZE; ++i) {
+                    if (step.at(i) != patternByte(0, offset + i)) {
+                        differences++;
+                        break;
+                    }
+                }
+            }
+        } else {
+            differences++;
+        }
+    }
+
+    printf("added a %d MB file in %.2f s, %.1f MB/s\n", megabytes, seconds, megabytes / qMax(seconds, 0.001));
+    if (peakBefore > 0) {
+        printf("peak resident size grew by %.1f MB\n", peakGrowth / (1024.0 * 1024.0));
+    }
+    printf("1 MB steps differing when read back: %d\n", differences);
+
+    QFile::remove(hostFilename);
+    QFile::remove(imageFilename);
+
+    return ((written && differences == 0 && peakGrowth <= fileSize / 4) ? 0 : 1);
+}
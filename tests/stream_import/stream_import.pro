@@ -0,0 +1,30 @@
+#-------------------------------------------------
+#
+# Peak memory while YaffsControl adds a large host
+# file to a new image, and a check of what it wrote
+#
+#-------------------------------------------------
+
+QT        += core
+QT        -= gui
+CONFIG    += console
+CONFIG    -= app_bundle
+
+TARGET     = stream_import
+TEMPLATE   = app
+
+INCLUDEPATH += ../.. ../common
+
+SOURCES   += \
+    stream_import.cpp \
+    ../../YaffsControl.cpp \
+    ../../YaffsChunkMap.cpp \
+    ../../yaffs2/yaffs_packedtags2.c \
+    ../../yaffs2/yaffs_hweight.c \
+    ../../yaffs2/yaffs_ecc.c
+
+HEADERS   += \
+    ../common/test_image.h \
+    ../../YaffsControl.h \
+    ../../YaffsChunkMap.h \
+    ../../Yaffs2.h
@@ -0,0 +1,173 @@
+/*
+ * yaffey: Utility for reading, editing and writing YAFFS2 images
+ * Copyright (C) 2012 David Place <david.t.place@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <QList>
+#include <QString>
+#include <QByteArray>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "YaffsObjectTable.h"
+
+//usage: table_memory [number of objects, 200000 by default]
+//exits with 1 if a header read back from the table differs from the one put in
+
+namespace {
+    //the members of YaffsItem before the object table, each item held its own header
+    struct OldItem {
+        OldItem* parentItem;
+        int headerPosition;
+        int yaffsObjectId;
+        QList<OldItem*> childItems;
+        yaffs_obj_hdr yaffsObjectHeader;
+        int condition;
+        QString externalFilename;
+        bool markedForDelete;
+        bool hasChildMarkedForDelete;
+        bool headerLoaded;
+        bool hasChildWithoutHeader;
+    };
+
+    //resident set size in bytes, 0 where /proc isn't there
+    long residentBytes() {
+        long pages = 0;
+        FILE* statm = fopen("/proc/self/statm", "r");
+        if (statm) {
+            long size;
+            if (fscanf(statm, "%ld %ld", &size, &pages) != 2) {
+                pages = 0;
+            }
+            fclose(statm);
+        }
+        return pages * sysconf(_SC_PAGESIZE);
+    }
+
+    //an Android system image in miniature: directories of a few dozen entries, many names repeated
+    //between directories (res, drawable, icon.png...), some unique ones, a few symlinks into bin
+    void makeHeader(int objectId, yaffs_obj_hdr& header) {
+        static const char* commonNames[] = { "res", "drawable", "drawable-hdpi", "layout", "values", "icon.png",
+                                             "classes.dex", "AndroidManifest.xml", "resources.arsc", "lib", "META-INF" };
+        int numCommonNames = sizeof(commonNames) / sizeof(commonNames[0]);
+
+        memset(&header, 0xff, sizeof(yaffs_obj_hdr));
+        memset(header.name, 0, sizeof(header.name));
+        memset(header.alias, 0, sizeof(header.alias));
+
+        int kind = objectId % 16;
+        if (kind == 0) {
+            header.type = YAFFS_OBJECT_TYPE_DIRECTORY;
+            snprintf(header.name, YAFFS_MAX_NAME_LENGTH, "%s", commonNames[(objectId / 16) % numCommonNames]);
+            header.yst_mode = 040755;
+            header.file_size_low = 0;
+        } else if (kind == 1) {
+            header.type = YAFFS_OBJECT_TYPE_SYMLINK;
+            snprintf(header.name, YAFFS_MAX_NAME_LENGTH, "tool%d", objectId % 200);
+            snprintf(header.alias, YAFFS_MAX_ALIAS_LENGTH, "toolbox");
+            header.yst_mode = 0120777;
+            header.file_size_low = 0;
+        } else {
+            header.type = YAFFS_OBJECT_TYPE_FILE;
+            if (kind < 8) {
+                snprintf(header.name, YAFFS_MAX_NAME_LENGTH, "%s", commonNames[objectId % numCommonNames]);
+            } else {
+                snprintf(header.name, YAFFS_MAX_NAME_LENGTH, "file_%07d_%s.png", objectId, (objectId & 1) ? "hdpi" : "mdpi");
+            }
+            header.yst_mode = 0100644;
+            header.file_size_low = (objectId * 2654435761u) % (256 * 1024);
+        }
+        header.parent_obj_id = 1 + objectId / 32;
+        header.yst_uid = (objectId % 3 == 0 ? 0 : 1000);
+        header.yst_gid = header.yst_uid;
+        header.yst_atime = 1230768000 + objectId;
+        header.yst_mtime = header.yst_atime;
+        header.yst_ctime = header.yst_atime;
+        header.equiv_id = -1;
+        header.file_size_high = 0xffffffff;
+        header.shadows_obj = -1;
+        header.is_shrink = 0;
+        header.sum_no_longer_used = 0xffff;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int numObjects = (argc > 1 ? atoi(argv[1]) : 200000);
+    if (numObjects <= 0) {
+        fprintf(stderr, "usage: table_memory [number of objects]\n");
+        return 1;
+    }
+
+    //both are kept until the end so neither can reuse memory the other freed
+    long before = residentBytes();
+    YaffsObjectTable table;
+    yaffs_obj_hdr header;
+    for (int i = 0; i < numObjects; ++i) {
+        makeHeader(i + 2, header);
+        table.append(i + 2, i * 64, header, true);
+    }
+    long tableBytes = residentBytes() - before;
+
+    before = residentBytes();
+    QList<OldItem*> oldItems;
+    for (int i = 0; i < numObjects; ++i) {
+        OldItem* item = new OldItem();
+        item->parentItem = (i > 0 ? oldItems.at(i / 32) : NULL);
+        item->headerPosition = i * 64;
+        item->yaffsObjectId = i + 2;
+        makeHeader(i + 2, item->yaffsObjectHeader);
+        item->condition = 0;
+        item->markedForDelete = false;
+        item->hasChildMarkedForDelete = false;
+        item->headerLoaded = true;
+        item->hasChildWithoutHeader = false;
+        if (item->parentItem) {
+            item->parentItem->childItems.append(item);
+        }
+        oldItems.append(item);
+    }
+    long oldBytes = residentBytes() - before;
+
+    //the table has to give back every byte of every header
+    int differences = 0;
+    yaffs_obj_hdr rebuilt;
+    for (int i = 0; i < numObjects; ++i) {
+        table.getHeader(i, rebuilt);
+        if (memcmp(&rebuilt, &oldItems.at(i)->yaffsObjectHeader, sizeof(yaffs_obj_hdr)) != 0) {
+            differences++;
+        }
+    }
+
+    printf("%d objects, sizeof(yaffs_obj_hdr) %d, sizeof(old item) %d\n", numObjects,
+           static_cast<int>(sizeof(yaffs_obj_hdr)), static_cast<int>(sizeof(OldItem)));
+    printf("object table: %10d bytes by memoryUsage(), %7.1f per object\n", table.memoryUsage(),
+           static_cast<double>(table.memoryUsage()) / numObjects);
+    if (tableBytes > 0 && oldBytes > 0) {
+        printf("object table: %10ld bytes resident,      %7.1f per object\n", tableBytes,
+               static_cast<double>(tableBytes) / numObjects);
+        printf("old items:    %10ld bytes resident,      %7.1f per object\n", oldBytes,
+               static_cast<double>(oldBytes) / numObjects);
+        printf("reduction:    %.1fx\n", static_cast<double>(oldBytes) / tableBytes);
+    }
+    printf("headers differing after a round trip: %d\n", differences);
+
+    qDeleteAll(oldItems);
+
+    return (differences == 0 ? 0 : 1);
+}
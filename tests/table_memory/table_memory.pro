@@ -0,0 +1,24 @@
+#-------------------------------------------------
+#
+# Memory per object of YaffsObjectTable against the
+# yaffs_obj_hdr copy every YaffsItem used to keep
+#
+#-------------------------------------------------
+
+QT        += core
+QT        -= gui
+CONFIG    += console
+CONFIG    -= app_bundle
+
+TARGET     = table_memory
+TEMPLATE   = app
+
+INCLUDEPATH += ../..
+
+SOURCES   += \
+    table_memory.cpp \
+    ../../YaffsObjectTable.cpp
+
+HEADERS   += \
+    ../../YaffsObjectTable.h \
+    ../../Yaffs2.h
@@ -0,0 +1,19 @@
+#-------------------------------------------------
+#
+# Tests and benchmarks, built apart from yaffey:
+#   cd tests && qmake && make
+#
+#-------------------------------------------------
+
+TEMPLATE   = subdirs
+
+SUBDIRS   += \
+    ecc_bench \
+    control_stress \
+    table_memory \
+    write_bench \
+    model_signals \
+    import_walk \
+    stream_import \
+    chunk_map \
+    dedup
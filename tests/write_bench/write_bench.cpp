@@ -0,0 +1,118 @@
+/*
+ * yaffey: Utility for reading, editing and writing YAFFS2 images
+ * Copyright (C) 2012 David Place <david.t.place@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <QDir>
+#include <QFileInfo>
+#include <QBuffer>
+#include <QElapsedTimer>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "YaffsControl.h"
+#include "test_image.h"
+
+extern "C" {
+    #include "yaffs2/yaffs_hweight.h"
+}
+
+//usage: write_bench [megabytes of file data, 500 by default] [directory for the image, the temp directory by default]
+//a batch of 1 page is the old way of one fwrite per page, PAGES_PER_BLOCK is the default
+
+#define MAX_FILE_SIZE       (4 * 1024 * 1024)
+
+namespace {
+    //the same files for every run: a quarter small, the rest up to MAX_FILE_SIZE
+    QList<int> makeFileSizes(qint64 totalBytes) {
+        QList<int> fileSizes;
+        u32 state = 1;
+        qint64 bytes = 0;
+        while (bytes < totalBytes) {
+            state = state * 1103515245u + 12345u;
+            int size = ((state >> 8) % 4 == 0 ? (state >> 4) % (16 * 1024) : (state >> 4) % MAX_FILE_SIZE);
+            size = static_cast<int>(qMin<qint64>(size, totalBytes - bytes));
+            fileSizes.append(size);
+            bytes += size;
+        }
+        return fileSizes;
+    }
+
+    //builds the whole image and returns the seconds it took, or a negative value if the save failed
+    double buildImage(const QString& imageFilename, int writeBatchPages, const QList<int>& fileSizes, QByteArray& data,
+                      long& pagesWritten) {
+        QElapsedTimer timer;
+        timer.start();
+
+        bool result = false;
+        {
+            YaffsControl image(imageFilename.toStdString().c_str(), NULL);
+            image.setWriteBatchPages(writeBatchPages);
+            if (image.open(YaffsControl::OPEN_NEW)) {
+                int headerPos = -1;
+                image.addRoot(makeHeader(YAFFS_OBJECT_TYPE_DIRECTORY, "", 0), headerPos);
+                for (int f = 0; f < fileSizes.size(); ++f) {
+                    QBuffer buffer(&data);
+                    buffer.open(QIODevice::ReadOnly);
+                    image.addFile(makeHeader(YAFFS_OBJECT_TYPE_FILE, QString("file%1").arg(f), fileSizes.at(f)), headerPos,
+                                  buffer, fileSizes.at(f));
+                }
+                result = (image.flush() && image.getSaveInfo().numFilesFailed == 0);
+            }
+        }       //closed here, so the time includes handing every page to the system
+
+        double seconds = timer.elapsed() / 1000.0;
+        pagesWritten = QFileInfo(imageFilename).size() / PAGE_SIZE;
+        QFile::remove(imageFilename);
+        return (result ? seconds : -1.0);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int megabytes = (argc > 1 ? atoi(argv[1]) : 500);
+    QString directory = (argc > 2 ? QString(argv[2]) : QDir::tempPath());
+    if (megabytes <= 0) {
+        fprintf(stderr, "usage: write_bench [megabytes] [directory]\n");
+        return 1;
+    }
+
+    yaffs_hweight_init();
+
+    QList<int> fileSizes = makeFileSizes(static_cast<qint64>(megabytes) * 1024 * 1024);
+    QByteArray data(MAX_FILE_SIZE, 0);
+    fillPattern(data, 0, 0);
+
+    QString imageFilename = directory + "/write_bench.img";
+    printf("%d MB of data in %d files, image in %s\n", megabytes, fileSizes.size(), qPrintable(directory));
+
+    static const int batches[] = { 1, PAGES_PER_BLOCK, 4 * PAGES_PER_BLOCK, 16 * PAGES_PER_BLOCK };
+    int numBatches = sizeof(batches) / sizeof(batches[0]);
+    int result = 0;
+    for (int b = 0; b < numBatches; ++b) {
+        long pagesWritten = 0;
+        double seconds = buildImage(imageFilename, batches[b], fileSizes, data, pagesWritten);
+        if (seconds < 0) {
+            fprintf(stderr, "batch of %d pages: the save failed\n", batches[b]);
+            result = 1;
+            continue;
+        }
+        printf("batch of %5d pages: %8ld pages in %6.2f s, %9.0f pages/s, %7.1f MB/s\n", batches[b], pagesWritten, seconds,
+               pagesWritten / qMax(seconds, 0.001), pagesWritten * static_cast<double>(PAGE_SIZE) / (1024 * 1024) / qMax(seconds, 0.001));
+    }
+
+    return result;
+}
@@ -0,0 +1,30 @@
+#-------------------------------------------------
+#
+# Pages per second building a new image with
+# YaffsControl, for several write batch sizes
+#
+#-------------------------------------------------
+
+QT        += core
+QT        -= gui
+CONFIG    += console
+CONFIG    -= app_bundle
+
+TARGET     = write_bench
+TEMPLATE   = app
+
+INCLUDEPATH += ../.. ../common
+
+SOURCES   += \
+    write_bench.cpp \
+    ../../YaffsControl.cpp \
+    ../../YaffsChunkMap.cpp \
+    ../../yaffs2/yaffs_packedtags2.c \
+    ../../yaffs2/yaffs_hweight.c \
+    ../../yaffs2/yaffs_ecc.c
+
+HEADERS   += \
+    ../common/test_image.h \
+    ../../YaffsControl.h \
+    ../../YaffsChunkMap.h \
+    ../../Yaffs2.h
@@ -22,7 +22,13 @@ SOURCES   += main.cpp\
     yaffs2/yaffs_ecc.c \
     DialogFastboot.cpp \
     DialogImport.cpp \
-    YaffsManager.cpp
+    YaffsManager.cpp \
+    YaffsIndex.cpp \
+    YaffsObjectTable.cpp \
+    YaffsChunkMap.cpp \
+    YaffsFileDevice.cpp \
+    YaffsWriter.cpp \
+    YaffsImporter.cpp
 
 HEADERS   += \
     MainWindow.h \
@@ -40,7 +46,13 @@ HEADERS   += \
     Yaffs2.h \
     DialogFastboot.h \
     DialogImport.h \
-    YaffsManager.h
+    YaffsManager.h \
+    YaffsIndex.h \
+    YaffsObjectTable.h \
+    YaffsChunkMap.h \
+    YaffsFileDevice.h \
+    YaffsWriter.h \
+    YaffsImporter.h
 
 FORMS     += \
     MainWindow.ui \
@@ -23,6 +23,8 @@
 
 //#include "yportenv.h"
 
+#include <string.h>
+
 #include "yaffs_ecc.h"
 #include "yaffs_hweight.h"
 
@@ -69,6 +71,88 @@ static const unsigned char column_parity_table[] = {
 };
 
 
+/*
+ * The table is linear, so the column parity of the data is the entry for
+ * all of its bytes xored together, and bit k of the line parity is the parity
+ * of the bytes whose offset has bit k set. That lets the data be folded a
+ * 64-bit word at a time instead of looked up a byte at a time. The byte
+ * offsets within a word assume a little-endian host, others use the tables.
+ */
+
+typedef unsigned long long ecc_word;
+
+#define ECC_WORD_BYTES	8
+#define ECC_WORD_SHIFT	3
+#define ECC_MAX_LINES	32
+
+/* lines within a word, bits 0..2 of the byte offset */
+static const ecc_word ecc_byte_lines[ECC_WORD_SHIFT] = {
+	0xff00ff00ff00ff00ULL,
+	0xffff0000ffff0000ULL,
+	0xffffffff00000000ULL
+};
+
+static int ecc_little_endian(void)
+{
+	const unsigned one = 1;
+	return *(const unsigned char *)&one;
+}
+
+static unsigned char ecc_fold(ecc_word x)
+{
+	x ^= x >> 32;
+	x ^= x >> 16;
+	x ^= x >> 8;
+	return (unsigned char)x;
+}
+
+static unsigned ecc_parity(ecc_word x)
+{
+	return column_parity_table[ecc_fold(x)] & 0x01;
+}
+
+/*
+ * Folds the whole words of the data, returning the number of bytes done.
+ * line_parity has bit k set when the odd bytes at offsets with bit k set are odd.
+ */
+static unsigned ecc_calc_words(const unsigned char *data, unsigned n_bytes,
+			       unsigned char *col_parity, unsigned *line_parity)
+{
+	unsigned n_words = n_bytes >> ECC_WORD_SHIFT;
+	ecc_word all = 0;
+	ecc_word lines[ECC_MAX_LINES - ECC_WORD_SHIFT];
+	ecc_word w;
+	unsigned i;
+	unsigned j;
+	unsigned k;
+	unsigned n_lines = 0;
+
+	for (j = 0; j < n_words; j++) {
+		memcpy(&w, data + (j << ECC_WORD_SHIFT), sizeof(w));
+		all ^= w;
+
+		for (k = 0; (j >> k) != 0; k++) {
+			if (k == n_lines)
+				lines[n_lines++] = 0;
+			if ((j >> k) & 1)
+				lines[k] ^= w;
+		}
+	}
+
+	*col_parity = column_parity_table[ecc_fold(all)];
+	*line_parity = 0;
+	for (i = 0; i < ECC_WORD_SHIFT; i++) {
+		if (ecc_parity(all & ecc_byte_lines[i]))
+			*line_parity |= 1 << i;
+	}
+	for (k = 0; k < n_lines; k++) {
+		if (ecc_parity(lines[k]))
+			*line_parity |= 1 << (k + ECC_WORD_SHIFT);
+	}
+
+	return n_words << ECC_WORD_SHIFT;
+}
+
 /* Calculate the ECC for a 256-byte block of data */
 void yaffs_ecc_calc(const unsigned char *data, unsigned char *ecc)
 {
@@ -79,13 +163,22 @@ void yaffs_ecc_calc(const unsigned char *data, unsigned char *ecc)
 	unsigned char t;
 	unsigned char b;
 
-	for (i = 0; i < 256; i++) {
-		b = column_parity_table[*data++];
-		col_parity ^= b;
-
-		if (b & 0x01) {	/* odd number of bits in the byte */
-			line_parity ^= i;
-			line_parity_prime ^= ~i;
+	if (ecc_little_endian()) {
+		unsigned lines;
+
+		ecc_calc_words(data, 256, &col_parity, &lines);
+		line_parity = (unsigned char)lines;
+		/* the xor of ~i over the odd bytes, which are odd in number when the column parity is */
+		line_parity_prime = line_parity ^ ((col_parity & 0x01) ? 0xff : 0x00);
+	} else {
+		for (i = 0; i < 256; i++) {
+			b = column_parity_table[*data++];
+			col_parity ^= b;
+
+			if (b & 0x01) {	/* odd number of bits in the byte */
+				line_parity ^= i;
+				line_parity_prime ^= ~i;
+			}
 		}
 	}
 
@@ -206,13 +299,20 @@ int yaffs_ecc_correct(unsigned char *data, unsigned char *read_ecc,
 void yaffs_ecc_calc_other(const unsigned char *data, unsigned n_bytes,
 			  struct yaffs_ecc_other *ecc_other)
 {
-	unsigned int i;
+	unsigned int i = 0;
 	unsigned char col_parity = 0;
 	unsigned line_parity = 0;
 	unsigned line_parity_prime = 0;
 	unsigned char b;
 
-	for (i = 0; i < n_bytes; i++) {
+	if (ecc_little_endian()) {
+		i = ecc_calc_words(data, n_bytes, &col_parity, &line_parity);
+		line_parity_prime = line_parity ^ ((col_parity & 0x01) ? ~0U : 0U);
+		data += i;
+	}
+
+	/* whatever is left after the last whole word */
+	for (; i < n_bytes; i++) {
 		b = column_parity_table[*data++];
 		col_parity ^= b;
 
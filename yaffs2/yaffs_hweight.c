@@ -43,7 +43,7 @@ int yaffs_hweight8(u8 x)
 	return ret_val;
 }
 
-int yaffs_hweight32(u32 x)
+static int yaffs_hweight32_table(u32 x)
 {
 	return yaffs_hweight8(x & 0xff) +
 		yaffs_hweight8((x >> 8) & 0xff) +
@@ -51,3 +51,44 @@ int yaffs_hweight32(u32 x)
 		yaffs_hweight8((x >> 24) & 0xff);
 }
 
+/*
+ * On x86 built with a gcc that can target single functions, the popcnt
+ * instruction is used when the cpu running the program has it.
+ */
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__)) && \
+	(__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 8))
+
+__attribute__((target("popcnt")))
+static int yaffs_hweight32_popcnt(u32 x)
+{
+	return __builtin_popcount(x);
+}
+
+/* chosen by yaffs_hweight_init(), before any other thread can call it */
+static int (*yaffs_hweight32_impl)(u32 x) = yaffs_hweight32_table;
+
+void yaffs_hweight_init(void)
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("popcnt"))
+		yaffs_hweight32_impl = yaffs_hweight32_popcnt;
+}
+
+int yaffs_hweight32(u32 x)
+{
+	return yaffs_hweight32_impl(x);
+}
+
+#else
+
+void yaffs_hweight_init(void)
+{
+}
+
+int yaffs_hweight32(u32 x)
+{
+	return yaffs_hweight32_table(x);
+}
+
+#endif
+
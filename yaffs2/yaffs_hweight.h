@@ -23,6 +23,8 @@ typedef unsigned char u8;
 typedef unsigned short u16;
 typedef unsigned u32;
 
+/* picks the fastest hweight32 for this cpu, call once before starting threads */
+void yaffs_hweight_init(void);
 int yaffs_hweight8(u8 x);
 int yaffs_hweight32(u32 x);
 